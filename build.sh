@@ -1 +1,3 @@
-g++ -g main.cpp -o sdl_app -lSDL2
+g++ -g -std=c++20 main.cpp chip8.cpp rompack.cpp capture.cpp debugger.cpp codemap.cpp scaler.cpp imagewriter.cpp -o sdl_app -lSDL2 -pthread
+g++ -g -std=c++20 capture_export.cpp capture.cpp imagewriter.cpp -o chip8capture -pthread
+g++ -g -std=c++20 rom_analyzer.cpp chip8.cpp codemap.cpp rompack.cpp -o chip8analyze
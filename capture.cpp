@@ -0,0 +1,231 @@
+#include "capture.h"
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+
+static void WriteVarint(std::vector<u8>& out, u64 value){
+  while(value >= 0x80){
+    out.push_back((u8)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((u8)value);
+}
+
+static b8 ReadVarint(std::ifstream& in, u64* value){
+  *value = 0;
+  for(u32 shift = 0; shift < 64; shift += 7){
+    const int byte = in.get();
+    if(byte == EOF){
+      return false;
+    }
+    *value |= (u64)(byte & 0x7F) << shift;
+    if(!(byte & 0x80)){
+      return true;
+    }
+  }
+  return false;
+}
+
+static void FlushRepeats(Capture* capture, std::vector<u8>& out){
+  if(capture->pendingRepeats){
+    out.push_back(CAPTURE_REPEAT);
+    WriteVarint(out, capture->pendingRepeats);
+    capture->pendingRepeats = 0;
+  }
+}
+
+static void EncodeFrame(Capture* capture, const CaptureSlot& slot, std::vector<u8>& out){
+  if(capture->hasPrevious && slot.frame > capture->previousFrame + 1){
+    capture->pendingRepeats += slot.frame - capture->previousFrame - 1;
+  }
+  u8 rows[DISPLAY_PLANES * CHIP8_HIRES_DISPLAY_HEIGHT];
+  u32 changedRows = 0;
+  for(u32 plane = 0; plane < DISPLAY_PLANES; plane++){
+    for(u32 row = 0; row < CHIP8_HIRES_DISPLAY_HEIGHT; row++){
+      const u64* current = slot.display[plane][row];
+      const u64* previous = capture->previous[plane][row];
+      if(memcmp(current, previous, CAPTURE_ROW_BYTES) != 0){
+        rows[changedRows++] = (u8)(plane << 6 | row);
+      }
+    }
+  }
+  capture->previousFrame = slot.frame;
+  if(capture->hasPrevious && changedRows == 0 && slot.hires == capture->previousHires){
+    capture->pendingRepeats++;
+    return;
+  }
+  FlushRepeats(capture, out);
+  out.push_back(CAPTURE_FRAME);
+  out.push_back(slot.hires ? 1 : 0);
+  WriteVarint(out, changedRows);
+  for(u32 i = 0; i < changedRows; i++){
+    const u32 plane = rows[i] >> 6;
+    const u32 row = rows[i] & 0x3F;
+    u8 delta[CAPTURE_ROW_BYTES];
+    for(u32 word = 0; word < DISPLAY_WORDS_PER_ROW; word++){
+      const u64 bits = slot.display[plane][row][word] ^ capture->previous[plane][row][word];
+      for(u32 byte = 0; byte < 8; byte++){
+        delta[word*8 + byte] = (u8)(bits >> (56 - byte*8));
+      }
+    }
+    u16 mask = 0;
+    for(u32 byte = 0; byte < CAPTURE_ROW_BYTES; byte++){
+      mask |= delta[byte] ? (1 << byte) : 0;
+    }
+    out.push_back(rows[i]);
+    out.push_back((u8)mask);
+    out.push_back((u8)(mask >> 8));
+    for(u32 byte = 0; byte < CAPTURE_ROW_BYTES; byte++){
+      if(delta[byte]){
+        out.push_back(delta[byte]);
+      }
+    }
+  }
+  memcpy(capture->previous, slot.display, sizeof(capture->previous));
+  capture->previousHires = slot.hires;
+  capture->hasPrevious = true;
+}
+
+static void RunEncoder(Capture* capture){
+  std::vector<u8> out;
+  while(true){
+    const u32 tail = capture->tail.load(std::memory_order_relaxed);
+    if(tail == capture->head.load(std::memory_order_acquire)){
+      if(!out.empty()){
+        //Once a write fails the stream stays failed, the queue keeps draining so the emulator never waits on it.
+        capture->file.write((const char*)out.data(), out.size());
+        out.clear();
+      }
+      if(!capture->running.load(std::memory_order_acquire)){
+        //Producer is done, one last look at the queue in case it pushed right before stopping.
+        if(tail == capture->head.load(std::memory_order_acquire)){
+          break;
+        }
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(capture->wakeMutex);
+      capture->frameReady.wait(lock, [&]{
+        return tail != capture->head.load(std::memory_order_acquire) || !capture->running.load(std::memory_order_acquire);
+      });
+      continue;
+    }
+    EncodeFrame(capture, capture->slots[tail % CAPTURE_QUEUE_SIZE], out);
+    capture->tail.store(tail + 1, std::memory_order_release);
+    if(capture->waitForSpace){
+      { std::lock_guard<std::mutex> lock(capture->wakeMutex); }
+      capture->slotFree.notify_one();
+    }
+  }
+}
+
+b8 StartCapture(Capture* capture, const char* path, u32 frameRate, b8 waitForSpace){
+  capture->file.open(path, std::ios::binary);
+  if(!capture->file){
+    std::cerr << "Unable to create capture " << path << std::endl;
+    return false;
+  }
+  CaptureHeader header = {};
+  memcpy(header.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+  header.version = CAPTURE_VERSION;
+  header.frameRate = frameRate;
+  capture->file.write((const char*)&header, sizeof(header));
+  if(!capture->file){
+    std::cerr << "Error writing " << path << std::endl;
+    capture->file.close();
+    return false;
+  }
+  capture->path = path;
+  capture->waitForSpace = waitForSpace;
+  memset(capture->previous, 0, sizeof(capture->previous));
+  capture->running.store(true, std::memory_order_release);
+  capture->encoder = std::thread(RunEncoder, capture);
+  return true;
+}
+
+b8 StopCapture(Capture* capture, u32 lastFrame){
+  if(!capture->running.load()){
+    return true;
+  }
+  capture->running.store(false, std::memory_order_release);
+  { std::lock_guard<std::mutex> lock(capture->wakeMutex); }
+  capture->frameReady.notify_one();
+  capture->encoder.join();
+  std::vector<u8> out;
+  if(capture->hasPrevious && lastFrame > capture->previousFrame){
+    capture->pendingRepeats += lastFrame - capture->previousFrame;
+  }
+  FlushRepeats(capture, out);
+  capture->file.write((const char*)out.data(), out.size());
+  const u64 size = capture->file.tellp();
+  capture->file.close();
+  if(!capture->file){
+    std::cerr << "Error writing " << capture->path << ", the capture is incomplete" << std::endl;
+    return false;
+  }
+  std::cout << "capture: " << size << " bytes, " << capture->dropped << " dropped frames" << std::endl;
+  return true;
+}
+
+b8 OpenCaptureReader(CaptureReader* reader, const char* path){
+  reader->file.open(path, std::ios::binary);
+  if(!reader->file){
+    std::cerr << "Unable to open capture " << path << std::endl;
+    return false;
+  }
+  if(!reader->file.read((char*)&reader->header, sizeof(reader->header))
+      || memcmp(reader->header.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0
+      || reader->header.version != CAPTURE_VERSION){
+    std::cerr << "File " << path << " is not a version " << CAPTURE_VERSION << " capture" << std::endl;
+    return false;
+  }
+  //Frame durations are divided by it.
+  if(reader->header.frameRate == 0){
+    std::cerr << "Capture " << path << " has a frame rate of 0" << std::endl;
+    return false;
+  }
+  memset(reader->display, 0, sizeof(reader->display));
+  return true;
+}
+
+b8 ReadCaptureRecord(CaptureReader* reader, u64* frames, b8* newImage){
+  const int record = reader->file.get();
+  if(record == EOF){
+    return false;
+  }
+  if(record == CAPTURE_REPEAT){
+    *newImage = false;
+    return ReadVarint(reader->file, frames);
+  }
+  if(record != CAPTURE_FRAME){
+    std::cerr << "Corrupt capture record " << record << std::endl;
+    return false;
+  }
+  const int flags = reader->file.get();
+  u64 rows = 0;
+  if(flags == EOF || !ReadVarint(reader->file, &rows)){
+    return false;
+  }
+  reader->hires = flags & 1;
+  for(u64 i = 0; i < rows; i++){
+    u8 entry[3];
+    if(!reader->file.read((char*)entry, sizeof(entry))){
+      return false;
+    }
+    const u32 plane = (entry[0] >> 6) & 1;
+    const u32 row = entry[0] & 0x3F;
+    const u16 mask = entry[1] | (entry[2] << 8);
+    for(u32 byte = 0; byte < CAPTURE_ROW_BYTES; byte++){
+      if(mask & (1 << byte)){
+        const int delta = reader->file.get();
+        if(delta == EOF){
+          return false;
+        }
+        reader->display[plane][row][byte / 8] ^= (u64)delta << (56 - (byte % 8)*8);
+      }
+    }
+  }
+  *frames = 1;
+  *newImage = true;
+  return true;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <cstring>
+#include <string>
+
+#include "types.h"
+#include "display.h"
+
+//Gameplay capture. The emulation thread copies each presented display into a lock-free single producer,
+//single consumer queue; a background thread turns them into a delta stream on disk. chip8capture exports
+//that stream to GIF or APNG. The mutex is only there so either side can sleep until the other catches up.
+//
+//Stream layout: CaptureHeader, then records until the end of the file.
+//  CAPTURE_REPEAT count            The current image stays up for count more frames.
+//  CAPTURE_FRAME flags rows entry* One new frame. flags bit 0 is hi-res, rows is the number of entries.
+//    entry: u8 (plane << 6 | row), u16 mask, one byte per set mask bit
+//    The bytes are the nonzero bytes of the row XORed with the previous frame, in pixel order.
+//Counts are LEB128 varints. Frames are 1/frameRate seconds apart; frames the queue dropped become repeats.
+
+constexpr char CAPTURE_MAGIC[8] = {'C', '8', 'C', 'A', 'P', 'T', '\0', '\0'};
+constexpr u32 CAPTURE_VERSION = 1;
+constexpr u32 CAPTURE_ROW_BYTES = DISPLAY_WORDS_PER_ROW * sizeof(u64);
+enum CaptureRecord : u8 {
+  CAPTURE_REPEAT = 0x00,
+  CAPTURE_FRAME = 0x01,
+};
+
+struct CaptureHeader{
+  char magic[8];
+  u32 version;
+  u32 frameRate;
+};
+static_assert(sizeof(CaptureHeader) == 16);
+
+struct CaptureSlot{
+  u32 frame;//Emulated frame number, gaps between presented frames are encoded as repeats.
+  b8 hires;
+  DisplayPlanes display;
+};
+
+constexpr u32 CAPTURE_QUEUE_SIZE = 128;//About two seconds of frames before any get dropped.
+struct Capture{
+  CaptureSlot slots[CAPTURE_QUEUE_SIZE];
+  std::atomic<u32> head{0};//Next slot the emulation thread writes, only it stores to head.
+  std::atomic<u32> tail{0};//Next slot the encoder reads, only it stores to tail.
+  std::atomic<b8> running{false};
+  b8 waitForSpace = false;//Headless runs have no deadline, a full queue blocks the emulator instead of dropping.
+  u64 dropped = 0;
+  std::mutex wakeMutex;
+  std::condition_variable frameReady;//Encoder sleeps on it while the queue is empty.
+  std::condition_variable slotFree;//Emulation thread sleeps on it while the queue is full, waitForSpace only.
+  std::thread encoder;
+  std::ofstream file;//Written by the encoder thread only, a failed write is reported by StopCapture.
+  std::string path;
+  //Encoder state, only touched by the encoder thread.
+  DisplayPlanes previous;
+  b8 previousHires = false;
+  b8 hasPrevious = false;
+  u32 previousFrame = 0;
+  u64 pendingRepeats = 0;
+};
+
+//Returns false and prints the reason if the stream can't be created.
+b8 StartCapture(Capture* capture, const char* path, u32 frameRate, b8 waitForSpace);
+//Called on the emulation thread: one memcpy into the queue. If the encoder fell behind the frame is dropped,
+//or with waitForSpace the call blocks until a slot is free.
+inline void CaptureFrame(Capture* capture, u32 frame, const DisplayPlanes& display, b8 hires){
+  const u32 head = capture->head.load(std::memory_order_relaxed);
+  if(head - capture->tail.load(std::memory_order_acquire) == CAPTURE_QUEUE_SIZE){
+    if(!capture->waitForSpace){
+      capture->dropped++;
+      return;
+    }
+    std::unique_lock<std::mutex> lock(capture->wakeMutex);
+    capture->slotFree.wait(lock, [&]{ return head - capture->tail.load(std::memory_order_acquire) != CAPTURE_QUEUE_SIZE; });
+  }
+  CaptureSlot& slot = capture->slots[head % CAPTURE_QUEUE_SIZE];
+  slot.frame = frame;
+  slot.hires = hires;
+  memcpy(slot.display, display, sizeof(slot.display));
+  capture->head.store(head + 1, std::memory_order_release);
+  //Taking the mutex orders the store against the encoder checking the queue right before it sleeps.
+  { std::lock_guard<std::mutex> lock(capture->wakeMutex); }
+  capture->frameReady.notify_one();
+}
+//Drains the queue, accounts for frames up to lastFrame and closes the stream.
+//Returns false and prints the reason if any part of the stream couldn't be written.
+b8 StopCapture(Capture* capture, u32 lastFrame);
+
+struct CaptureReader{
+  std::ifstream file;
+  CaptureHeader header;
+  DisplayPlanes display;
+  b8 hires = false;
+};
+b8 OpenCaptureReader(CaptureReader* reader, const char* path);
+//Applies the next record. frames is set to how many frames it adds to the timeline and newImage to whether
+//the display changed. Returns false at the end of the stream.
+b8 ReadCaptureRecord(CaptureReader* reader, u64* frames, b8* newImage);
@@ -0,0 +1,138 @@
+//chip8capture: turns a capture stream recorded with chip8 --capture into an animated GIF or APNG.
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "display.h"
+#include "capture.h"
+#include "imagewriter.h"
+
+enum ExportFormat {
+  EXPORT_GIF,
+  EXPORT_APNG,
+};
+
+struct Exporter{
+  ExportFormat format;
+  u32 scale;
+  u32 frameRate;
+  GifWriter gif;
+  ApngWriter apng;
+  std::vector<u8> pixels;
+  f64 pendingCentiseconds = 0.0;
+  u64 framesWritten = 0;
+};
+
+void ScaleImage(const u8 indices[CHIP8_HIRES_DISPLAY_HEIGHT][CHIP8_HIRES_DISPLAY_WIDTH], u32 scale, std::vector<u8>& out){
+  const u32 width = CHIP8_HIRES_DISPLAY_WIDTH * scale;
+  out.resize((size_t)width * CHIP8_HIRES_DISPLAY_HEIGHT * scale);
+  for(u32 y = 0; y < CHIP8_HIRES_DISPLAY_HEIGHT * scale; y++){
+    for(u32 x = 0; x < width; x++){
+      out[(size_t)y * width + x] = indices[y / scale][x / scale];
+    }
+  }
+}
+
+//Writes the current image, shown for the given number of capture frames.
+void EmitImage(Exporter& exporter, u64 frames, b8 last){
+  if(exporter.format == EXPORT_APNG){
+    u64 numerator = frames;
+    u64 denominator = exporter.frameRate;
+    if(numerator > 0xFFFF){
+      numerator = std::min<u64>(0xFFFF, frames / exporter.frameRate);
+      denominator = 1;
+    }
+    ApngAddFrame(&exporter.apng, exporter.pixels.data(), (u16)numerator, (u16)denominator);
+    exporter.framesWritten++;
+    return;
+  }
+  //GIF delays are in centiseconds and most viewers treat anything below 2 as 10, so frames shorter than
+  //that are dropped and their time goes to the next one.
+  exporter.pendingCentiseconds += frames * 100.0 / exporter.frameRate;
+  if(exporter.pendingCentiseconds < 2.0 && !last){
+    return;
+  }
+  const u32 delay = std::min<u32>(0xFFFF, std::max<u32>(2, (u32)exporter.pendingCentiseconds));
+  exporter.pendingCentiseconds = std::max(0.0, exporter.pendingCentiseconds - delay);
+  GifAddFrame(&exporter.gif, exporter.pixels.data(), (u16)delay);
+  exporter.framesWritten++;
+}
+
+int main(int argc, char* argv[]){
+  const char* inputPath = nullptr;
+  const char* outputPath = nullptr;
+  u32 scale = 4;
+  for(int i = 1; i < argc; i++){
+    if(strcmp(argv[i], "--scale") == 0 && i + 1 < argc){
+      scale = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+    }
+    else if(!inputPath){
+      inputPath = argv[i];
+    }
+    else{
+      outputPath = argv[i];
+    }
+  }
+  if(!inputPath || !outputPath){
+    std::cerr << "Usage: chip8capture <capture> <output.gif|output.png|output.apng> [--scale <n>]" << std::endl;
+    return 1;
+  }
+  const std::string output = outputPath;
+  const b8 gif = output.size() >= 4 && output.compare(output.size() - 4, 4, ".gif") == 0;
+
+  CaptureReader reader;
+  if(!OpenCaptureReader(&reader, inputPath)){
+    return 1;
+  }
+  //Look for the first image before creating the output, a capture without one would make an invalid file.
+  u64 totalFrames = 0;
+  u64 frames = 0;
+  b8 newImage = false;
+  while(!newImage && ReadCaptureRecord(&reader, &frames, &newImage)){
+    totalFrames += frames;
+  }
+  if(!newImage){
+    std::cerr << "Capture " << inputPath << " has no frames" << std::endl;
+    return 1;
+  }
+  Exporter exporter;
+  exporter.format = gif ? EXPORT_GIF : EXPORT_APNG;
+  exporter.scale = scale;
+  exporter.frameRate = reader.header.frameRate;
+  const u32 width = CHIP8_HIRES_DISPLAY_WIDTH * scale;
+  const u32 height = CHIP8_HIRES_DISPLAY_HEIGHT * scale;
+  const u32 paletteSize = sizeof(PALETTE)/sizeof(PALETTE[0]);
+  const b8 opened = gif ? GifBegin(&exporter.gif, outputPath, width, height, PALETTE, paletteSize)
+                        : ApngBegin(&exporter.apng, outputPath, width, height, PALETTE, paletteSize);
+  if(!opened){
+    return 1;
+  }
+
+  u8 indices[CHIP8_HIRES_DISPLAY_HEIGHT][CHIP8_HIRES_DISPLAY_WIDTH];
+  ExpandDisplay(reader.display, reader.hires, indices);
+  ScaleImage(indices, scale, exporter.pixels);
+  u64 imageFrames = frames;
+  while(ReadCaptureRecord(&reader, &frames, &newImage)){
+    totalFrames += frames;
+    if(!newImage){
+      imageFrames += frames;
+      continue;
+    }
+    EmitImage(exporter, imageFrames, false);
+    ExpandDisplay(reader.display, reader.hires, indices);
+    ScaleImage(indices, scale, exporter.pixels);
+    imageFrames = frames;
+  }
+  EmitImage(exporter, imageFrames, true);
+  const b8 written = gif ? GifEnd(&exporter.gif) : ApngEnd(&exporter.apng);
+  if(!written){
+    std::cerr << "Error writing " << outputPath << std::endl;
+    return 1;
+  }
+  std::cout << totalFrames << " capture frames (" << totalFrames / (f64)exporter.frameRate << "s) -> "
+    << exporter.framesWritten << " frames in " << outputPath << std::endl;
+  return 0;
+}
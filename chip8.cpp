@@ -0,0 +1,279 @@
+#include "chip8.h"
+
+#include <cstring>
+
+const PlatformProfile* FindPlatform(const char* id){
+  for(const PlatformProfile& platform : PLATFORMS){
+    if(strcmp(platform.id, id) == 0){
+      return &platform;
+    }
+  }
+  return nullptr;
+}
+const PlatformProfile* DefaultPlatformFor(u64 romSize){
+  return FindPlatform(romSize > KB(4) - ROM_START ? "xochip" : DEFAULT_PLATFORM);
+}
+
+std::unordered_map<Operation, std::string> OperationToString = {
+  {CLS,"CLS"},
+  {RET,"RET"},
+  {SCD,"SCD"},
+  {SCU,"SCU"},
+  {SCR,"SCR"},
+  {SCL,"SCL"},
+  {EXIT,"EXIT"},
+  {LOW,"LOW"},
+  {HIGH,"HIGH"},
+  {JP,"JP"},
+  {CALL,"CALL"},
+  {SE_IMM,"SE_IMM"},
+  {SNE_IMM,"SNE_IMM"},
+  {SE_REG,"SE_REG"},
+  {ST_RANGE,"ST_RANGE"},
+  {LD_RANGE,"LD_RANGE"},
+  {SNE_REG,"SNE_REG"},
+  {LDX_IMM,"LDX_IMM"},
+  {LDX_REG,"LDX_REG"},
+  {ORX_REG,"ORX_REG"},
+  {ANDX_REG,"ANDX_REG"},
+  {XORX_REG,"XORX_REG"},
+  {ADDX_REG,"ADDX_REG"},
+  {SUB_REG,"SUB_REG"},
+  {SUBN_REG,"SUBN_REG"},
+  {SHR,"SHR"},
+  {SHL,"SHL"},
+  {ADDX_IMM,"ADDX_IMM"},
+  {SETI,"SETI"},
+  {JPOFFSET,"JPOFFSET"},
+  {RND,"RND"},
+  {SKP,"SKP"},
+  {SKNP,"SKNP"},
+  {DRAW,"DRAW"},
+  {LDX_TIMER,"LDX_TIMER"},
+  {LD_DT,"LD_DT"},
+  {LD_ST,"LD_ST"},
+  {ADDI_X,"ADDI_X"},
+  {LD_KEY,"LD_KEY"},
+  {LD_FONT,"LD_FONT"},
+  {BCD,"BCD"},
+  {LD_HFONT,"LD_HFONT"},
+  {ST_FLAGS,"ST_FLAGS"},
+  {LD_FLAGS,"LD_FLAGS"},
+  {LONG_I,"LONG_I"},
+  {PLANE,"PLANE"},
+  {AUDIO,"AUDIO"},
+  {PITCH,"PITCH"},
+  {ST_MEM,"ST_MEM"},
+  {LD_MEM,"LD_MEM"},
+  {SENTINEL_OP,"SENTINEL_OP"},
+};
+//The SUPER-CHIP and XO-CHIP opcodes are 0NNN machine calls or unused words on the other platforms.
+static b8 PlatformSupports(const PlatformProfile* platform, Operation op){
+  switch(op){
+    case Operation::SCD:
+    case Operation::SCR:
+    case Operation::SCL:
+    case Operation::EXIT:
+    case Operation::LOW:
+    case Operation::HIGH:
+    case Operation::LD_HFONT:
+    case Operation::ST_FLAGS:
+    case Operation::LD_FLAGS:
+      return platform->hires;
+    case Operation::SCU:
+    case Operation::ST_RANGE:
+    case Operation::LD_RANGE:
+    case Operation::LONG_I:
+    case Operation::PLANE:
+    case Operation::AUDIO:
+    case Operation::PITCH:
+      return platform->xo;
+    default:
+      return true;
+  }
+}
+Operation GetOperation(u16 inst, const PlatformProfile* platform)
+{
+  u16 maskedInst = inst & OP_MASK;
+  Operation op = SENTINEL_OP;
+  switch(maskedInst){
+    case 0:
+      switch(inst){
+        case Operation::CLS:
+          op = Operation::CLS;
+          break;
+        case Operation::RET:
+          op = Operation::RET;
+          break;
+        case Operation::SCR:
+          op = Operation::SCR;
+          break;
+        case Operation::SCL:
+          op = Operation::SCL;
+          break;
+        case Operation::EXIT:
+          op = Operation::EXIT;
+          break;
+        case Operation::LOW:
+          op = Operation::LOW;
+          break;
+        case Operation::HIGH:
+          op = Operation::HIGH;
+          break;
+      }
+      switch(inst & 0xFFF0){//Need to mask off N to get the vertical scrolls
+        case Operation::SCD:
+          op = Operation::SCD;
+          break;
+        case Operation::SCU:
+          op = Operation::SCU;
+          break;
+      }
+      break;
+    case 0x5000:
+      switch(inst & 0xF00F){
+        case Operation::SE_REG:
+          op = Operation::SE_REG;
+          break;
+        case Operation::ST_RANGE:
+          op = Operation::ST_RANGE;
+          break;
+        case Operation::LD_RANGE:
+          op = Operation::LD_RANGE;
+          break;
+      }
+      break;
+    case 0xE000:
+      switch(inst & 0xE0FF){//Need to mask off X to get the opcode 
+        case Operation::SKP:
+          op = Operation::SKP;
+          break;
+        case Operation::SKNP:
+          op = Operation::SKNP;
+          break;
+      }
+      break;
+    case 0xF000:
+      switch(inst & 0xF0FF){
+        case Operation::LDX_TIMER:
+          op = Operation::LDX_TIMER;
+          break;
+        case Operation::LD_DT:
+          op = Operation::LD_DT;
+          break;
+        case Operation::LD_ST:
+          op = Operation::LD_ST;
+          break;
+        case Operation::ADDI_X:
+          op = Operation::ADDI_X;
+          break;
+        case Operation::LD_KEY:
+          op = Operation::LD_KEY;
+          break;
+        case Operation::LD_FONT:
+          op = Operation::LD_FONT;
+          break;
+        case Operation::BCD:
+          op = Operation::BCD;
+          break;
+        case Operation::ST_MEM:
+          op = Operation::ST_MEM;
+          break;
+        case Operation::LD_MEM:
+          op = Operation::LD_MEM;
+          break;
+        case Operation::LD_HFONT:
+          op = Operation::LD_HFONT;
+          break;
+        case Operation::ST_FLAGS:
+          op = Operation::ST_FLAGS;
+          break;
+        case Operation::LD_FLAGS:
+          op = Operation::LD_FLAGS;
+          break;
+        case Operation::LONG_I:
+          if(inst == Operation::LONG_I){//Only F000 itself, FX00 isn't an instruction.
+            op = Operation::LONG_I;
+          }
+          break;
+        case Operation::PLANE:
+          op = Operation::PLANE;
+          break;
+        case Operation::AUDIO:
+          op = Operation::AUDIO;
+          break;
+        case Operation::PITCH:
+          op = Operation::PITCH;
+          break;
+      }
+      break;
+    case 0x8000:
+      switch(inst & 0x800f){
+        case Operation::LDX_REG:
+          op = Operation::LDX_REG;
+          break;
+        case Operation::ORX_REG:
+          op = Operation::ORX_REG;
+          break;
+        case Operation::ANDX_REG:
+          op = Operation::ANDX_REG;
+          break;
+        case Operation::XORX_REG:
+          op = Operation::XORX_REG;
+          break;
+        case Operation::ADDX_REG:
+          op = Operation::ADDX_REG;
+          break;
+        case Operation::SUB_REG:
+          op = Operation::SUB_REG;
+          break;
+        case Operation::SUBN_REG:
+          op = Operation::SUBN_REG;
+          break;
+        case Operation::SHR:
+          op = Operation::SHR;
+          break;
+        case Operation::SHL:
+          op = Operation::SHL;
+          break;
+      }
+      break;
+    case Operation::CALL:
+      op = Operation::CALL;
+      break;
+    case Operation::SE_IMM:
+      op = Operation::SE_IMM;
+      break;
+    case Operation::SNE_IMM:
+      op = Operation::SNE_IMM;
+      break;
+    case Operation::SNE_REG:
+      op = Operation::SNE_REG;
+      break;
+    case Operation::JP:
+      op = Operation::JP;
+      break;
+    case Operation::DRAW:
+      op = Operation::DRAW;
+      break;
+    case Operation::LDX_IMM:
+      op = Operation::LDX_IMM;
+      break;
+    case Operation::ADDX_IMM:
+      op = Operation::ADDX_IMM;
+      break;
+    case Operation::SETI:
+      op = Operation::SETI;
+      break;
+    case Operation::RND:
+      op = Operation::RND;
+      break;
+    case Operation::JPOFFSET:
+      op = Operation::JPOFFSET;
+      break;
+  }
+  if(!PlatformSupports(platform, op)){
+    op = Operation::SENTINEL_OP;
+  }
+  return op;
+}
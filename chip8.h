@@ -0,0 +1,291 @@
+#pragma once
+#include <unordered_map>
+#include <string>
+#include <assert.h>
+
+#include "types.h"
+#include "display.h"
+
+//
+//NOTE 1KB? maybe we'll need more? who knows.
+#define STACK_SIZE 1024 
+struct Stack{
+  u16 memory[STACK_SIZE];
+  u32 counter = 0;
+  void Push(u16 address){
+    assert(counter < STACK_SIZE);
+    memory[counter++] = address;
+  }
+  u16 Pop(){
+    if(counter > 0){
+      return memory[--counter];
+    }
+    return 0;
+  }
+};
+// #define RAM_SIZE 4096
+//NOTE: Always allocate the full 64KB XO-CHIP address space, a u16 address can then never index out of bounds.
+#define RAM_SIZE KB(64)
+#define ROM_START 0x200
+
+struct Quirks{
+  b8 shift;//8XY6/8XYE shift VX in place and ignore VY.
+  b8 memoryIncrementByX;//FX55/FX65 leave I at I + X.
+  b8 memoryLeaveIUnchanged;//FX55/FX65 don't touch I at all.
+  b8 wrap;//Sprites wrap around the edges of the screen instead of being clipped.
+  b8 jump;//BNNN behaves as BXNN.
+  b8 vblank;//DRAW waits for the vertical blank.
+  b8 logic;//8XY1/8XY2/8XY3 reset VF.
+};
+struct PlatformProfile{
+  const char* id;
+  u32 defaultTickrate;
+  u32 memorySize;//Addressable memory, the ROM has to fit in memorySize - ROM_START.
+  b8 hires;//128x64 mode, 16x16 sprites and scrolling.
+  b8 xo;//XO-CHIP extensions: bitplanes, long I, register ranges and the audio pattern buffer.
+  Quirks quirks;
+};
+//NOTE: Mirrors platforms.json, keep the two in sync. MEGA-CHIP opcodes aren't implemented, it runs as SUPER-CHIP.
+//inline: one table for the whole program, FindPlatform results are compared and subtracted against it.
+inline constexpr PlatformProfile PLATFORMS[] = {
+  //id              tick  memory  hires  xo     shift  incByX leaveI wrap   jump   vblank logic
+  {"originalChip8", 15,   KB(4),  false, false, {false, false, false, false, false, true,  true}},
+  {"hybridVIP",     15,   KB(4),  false, false, {false, false, false, false, false, true,  true}},
+  {"modernChip8",   12,   KB(4),  false, false, {false, false, false, false, false, false, false}},
+  {"chip8x",        15,   KB(4),  false, false, {false, false, false, false, false, true,  true}},
+  {"chip48",        30,   KB(4),  false, false, {true,  true,  false, false, true,  false, false}},
+  {"superchip1",    30,   KB(4),  true,  false, {true,  true,  false, false, true,  false, false}},
+  {"superchip",     30,   KB(4),  true,  false, {true,  false, true,  false, true,  false, false}},
+  {"megachip8",     1000, KB(4),  true,  false, {true,  false, true,  false, true,  false, false}},
+  {"xochip",        100,  KB(64), true,  true,  {false, false, false, true,  false, false, false}},
+};
+constexpr const char* DEFAULT_PLATFORM = "modernChip8";
+constexpr u32 PLATFORM_COUNT = sizeof(PLATFORMS)/sizeof(PLATFORMS[0]);
+const PlatformProfile* FindPlatform(const char* id);
+//Only XO-CHIP can address more than 4KB, anything bigger can't be for another platform.
+const PlatformProfile* DefaultPlatformFor(u64 romSize);
+
+constexpr u16 OP_MASK = 15 << 12;
+constexpr u16 X_MASK = 15 << 8;
+constexpr u16 Y_MASK = 15 << 4;
+constexpr u16 N_MASK = 15 << 0;
+constexpr u16 NN_MASK = 255 << 0;
+constexpr u16 NNN_MASK = 4095;
+
+#define MASK_OP(inst) (((inst) & OP_MASK) >> 12)
+#define MASK_X(inst) (((inst) & X_MASK) >> 8)
+#define MASK_Y(inst) (((inst) & Y_MASK) >> 4)
+#define MASK_N(inst) (((inst) & N_MASK) >> 0)
+#define MASK_NN(inst) (((inst) & NN_MASK) >> 0)
+#define MASK_NNN(inst) (u16)(((inst) & NNN_MASK) >> 0)
+
+
+enum Operation : u16 {
+	CLS = 0x00E0,
+  RET = 0x00EE,
+  //SUPER-CHIP
+  SCD = 0x00C0,//Scroll down N rows
+  SCR = 0x00FB,//Scroll right 4 pixels
+  SCL = 0x00FC,//Scroll left 4 pixels
+  EXIT = 0x00FD,
+  LOW = 0x00FE,//Lo-res (64x32) mode
+  HIGH = 0x00FF,//Hi-res (128x64) mode
+  //XO-CHIP
+  SCU = 0x00D0,//Scroll up N rows
+	JP = 0x1000,
+  CALL = 0x2000,
+  SE_IMM = 0x3000,
+  SNE_IMM = 0x4000,
+  SE_REG = 0x5000,
+  ST_RANGE = 0x5002,//XO-CHIP: store VX..VY at I, works in either direction and leaves I unchanged.
+  LD_RANGE = 0x5003,//XO-CHIP: load VX..VY from I.
+  SNE_REG = 0x9000,
+	LDX_IMM = 0x6000,
+  LDX_REG = 0x8000,
+  ORX_REG = 0x8001,
+  ANDX_REG = 0x8002,
+  XORX_REG = 0x8003,
+	ADDX_REG = 0x8004,
+  SUB_REG = 0x8005,
+  SUBN_REG = 0x8007,
+  /*NOTE: shifting are ambiguous instructions: 
+  the CHIP-8 interpreter for the original COSMAC VIP, this instruction did the following: It put the value of VY into VX, and then shifted the value in VX 1 bit to the right (8XY6) or left (8XYE). VY was not affected, but the flag register VF would be set to the bit that was shifted out.
+  However, starting with CHIP-48 and SUPER-CHIP in the early 1990s, these instructions were changed so that they shifted VX in place, and ignored the Y completely.
+  
+  This is one of the main differences between implementations that cause problems for programs. Since different games expect different behavior, you could consider making the behavior configurable by the user.*/
+  SHR = 0x8006,
+  SHL = 0x800E,
+	ADDX_IMM = 0x7000,
+	SETI = 0xA000,
+  /*Ambiguous instruction!
+  In the original COSMAC VIP interpreter, this instruction jumped to the address NNN plus the value in the register V0. This was mainly used for “jump tables”, to quickly be able to jump to different subroutines based on some input.
+  Starting with CHIP-48 and SUPER-CHIP, it was (probably unintentionally) changed to work as BXNN: It will jump to the address XNN, plus the value in the register VX. So the instruction B220 will jump to address 220 plus the value in the register V2.
+  The BNNN instruction was not widely used, so you might be able to just implement the first behavior (if you pick one, that’s definitely the one to go with). If you want to support a wide range of CHIP-8 programs, make this “quirk” configurable.*/
+  JPOFFSET = 0xB000,//Quirks::jump picks the behaviour per platform.
+  RND = 0xC000,
+  //Skip if de/pressed
+  SKP = 0xE09E,
+  SKNP = 0xE0A1,
+	DRAW = 0xD000,
+  //Timers
+  LDX_TIMER = 0xF007,
+  LD_DT = 0xF015,//Load delay timer
+  LD_ST = 0xF018,//Load sound timer
+  ADDI_X = 0xF01E,//Unlike other arithmetic instructions, this did not affect VF on overflow on the original COSMAC VIP. However, it seems that some interpreters set VF to 1 if I “overflows” from 0FFF to above 1000 (outside the normal addressing range). This wasn’t the case on the original COSMAC VIP, at least, but apparently the CHIP-8 interpreter for Amiga behaved this way. At least one known game, Spacefight 2091!, relies on this behavior. I don’t know of any games that rely on this not happening, so perhaps it’s safe to do it like the Amiga interpreter did.
+  LD_KEY = 0xF00A,
+  LD_FONT = 0xF029,//Load I register with the address of font for character in X
+  BCD = 0xF033,
+  LD_HFONT = 0xF030,//SUPER-CHIP: Load I register with the address of the big font for character in X
+  ST_FLAGS = 0xF075,//SUPER-CHIP: store V0..VX in the RPL user flags
+  LD_FLAGS = 0xF085,//SUPER-CHIP: load V0..VX from the RPL user flags
+  LONG_I = 0xF000,//XO-CHIP: F000 NNNN, load I with the 16 bit address that follows the instruction.
+  PLANE = 0xF001,//XO-CHIP: FN01, select the bitplanes that drawing, clearing and scrolling affect.
+  AUDIO = 0xF002,//XO-CHIP: load the 16 byte audio pattern buffer from I.
+  PITCH = 0xF03A,//XO-CHIP: set the audio pattern playback rate to 4000*2^((VX-64)/48) Hz.
+
+
+
+  /*
+  * Ambiguous instruction!
+  *
+  * These two instructions store registers to memory, or load them from memory, respectively.
+  *
+  * For FX55, the value of each variable register from V0 to VX inclusive (if X is 0, then only V0) will be stored in successive memory addresses, starting with the one that’s stored in I. V0 will be stored at the address in I, V1 will be stored in I + 1, and so on, until VX is stored in I + X.
+*
+* FX65 does the opposite; it takes the value stored at the memory addresses and loads them into the variable registers instead.
+*
+* The original CHIP-8 interpreter for the COSMAC VIP actually incremented the I register while it worked. Each time it stored or loaded one register, it incremented I. After the instruction was finished, I would end up being set to the new value I + X + 1.
+*
+* However, modern interpreters (starting with CHIP48 and SUPER-CHIP in the early 90s) used a temporary variable for indexing, so when the instruction was finished, I would still hold the same value as it did before.
+*
+  * If you only pick one behavior, go with the modern one that doesn’t actually change the value of I. This will let you run the common CHIP-8 games you find everywhere, and it’s also what the common test ROMs depend on (the other behavior will fail the tests). But if you want your emulator to run older games from the 1970s or 1980s, you should consider making a configurable option in your emulator to toggle between these behaviors.
+*/
+  ST_MEM = 0xF055,
+  LD_MEM = 0xF065,
+  SENTINEL_OP = 0xFFFF,
+  //Only ever found in Chip8Context::decoded, never returned by GetOperation.
+  UNDECODED = 0xFFFE,//Decode the instruction at this address on its next execution.
+  BREAKPOINT = 0xFFFD,//Debugger breakpoint, see debugger.h.
+};
+
+struct Debugger;
+struct Chip8Context {
+	i8 *ram;
+	DisplayPlanes display;
+	u16 PC;
+	u16 indexRegister;
+  Stack stack;
+	u8 delayTimer;
+	u8 soundTimer;
+	union {
+		struct {
+			u8 V0;
+			u8 V1;
+			u8 V2;
+			u8 V3;
+			u8 V4;
+			u8 V5;
+			u8 V6;
+			u8 V7;
+			u8 V8;
+			u8 V9;
+			u8 VA;
+			u8 VB;
+			u8 VC;
+			u8 VD;
+			u8 VE;
+			u8 VF;
+		};
+		u8 registers[16];
+	};
+	union{
+		struct{
+			b8 btn0;
+			b8 btn1;
+			b8 btn2;
+			b8 btn3;
+			b8 btn4;
+			b8 btn5;
+			b8 btn6;
+			b8 btn7;
+			b8 btn8;
+			b8 btn9;
+			b8 btnA;
+			b8 btnB;
+			b8 btnC;
+			b8 btnD;
+			b8 btnE;
+			b8 btnF;
+		};
+		b8 buttons[16];
+	};
+  u32 instructionsPerformed = 0;
+  b8 getKey = false;
+  u8 getKeyPressed = 0xFF;
+  const PlatformProfile* platform = nullptr;
+  b8 hires = false;
+  b8 displayDirty = true;//Set when the display changed since it was last presented.
+  b8 exit = false;//SUPER-CHIP 00FD
+  b8 stop = false;//Leave the instruction loop after the current instruction, set by EXIT and the debugger.
+  b8 vblankWait = false;//A DRAW ended the frame to wait for the display interrupt, it draws once the next frame starts.
+  u32 cycles = 0;//Microseconds of VIP time spent in the current frame, only counted with --vip-timing.
+  u8 planeMask = 1;//XO-CHIP FN01, bit 0 selects plane 1 and bit 1 selects plane 2.
+  u8 audioPattern[16];//XO-CHIP F002, 128 1-bit samples.
+  u8 pitch = 64;//XO-CHIP FX3A
+  u8 flags[16];//SUPER-CHIP RPL user flags, FX75/FX85.
+  Operation* decoded;//Decoded instruction for every address, RAM_SIZE entries. Writes to ram must invalidate it.
+  Debugger* debugger = nullptr;
+  b8 watching = false;//Any watchpoints set, memory instructions only check them when this is true.
+};
+
+inline u32 DisplayWidth(const Chip8Context& ctx){
+  return ctx.hires ? CHIP8_HIRES_DISPLAY_WIDTH : CHIP8_DISPLAY_WIDTH;
+}
+inline u32 DisplayHeight(const Chip8Context& ctx){
+  return ctx.hires ? CHIP8_HIRES_DISPLAY_HEIGHT : CHIP8_DISPLAY_HEIGHT;
+}
+
+//Approximate COSMAC VIP interpreter times in microseconds, fetch and decode included, used by --vip-timing.
+//The published DXYN average (about 22.7ms) includes waiting for the display interrupt, the vblank quirk
+//models that wait by ending the frame, so DRAW is only charged for the drawing itself.
+constexpr u32 VIP_FRAME_MICROSECONDS = 1000000 / 60;
+constexpr u16 VIP_DRAW_MICROSECONDS = 22734 - VIP_FRAME_MICROSECONDS;
+constexpr u16 VIP_GROUP_MICROSECONDS[16] = {
+  105,//0NNN, 00EE
+  105,//1NNN
+  105,//2NNN
+  55,//3XNN
+  55,//4XNN
+  73,//5XY0
+  27,//6XNN
+  45,//7XNN
+  200,//8XYN
+  73,//9XY0
+  55,//ANNN
+  105,//BNNN
+  164,//CXNN
+  VIP_DRAW_MICROSECONDS,//DXYN
+  73,//EX9E, EXA1
+  45,//FX07, FX0A, FX15, FX18
+};
+inline u32 VipInstructionTime(u16 inst){
+  if(inst == 0x00E0){
+    return 109;
+  }
+  if((inst & 0xF000) == 0xF000){
+    switch(inst & 0xFF){
+      case 0x1E: return 86;
+      case 0x29: return 91;
+      case 0x33: return 927;
+      case 0x55:
+      case 0x65: return 605;
+      default: break;
+    }
+  }
+  return VIP_GROUP_MICROSECONDS[inst >> 12];
+}
+
+extern std::unordered_map<Operation, std::string> OperationToString;
+//Returns SENTINEL_OP for words that aren't an instruction on the platform, SUPER-CHIP and XO-CHIP opcodes included.
+//Never prints, the analyzer decodes data too. Reporting unimplemented instructions is up to the caller.
+Operation GetOperation(u16 inst, const PlatformProfile* platform);
@@ -0,0 +1,70 @@
+#include "codemap.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+void InitCodeMap(CodeMap* map, u64 romHash, u32 romSize){
+  map->header = {};
+  memcpy(map->header.magic, CODE_MAP_MAGIC, sizeof(CODE_MAP_MAGIC));
+  map->header.version = CODE_MAP_VERSION;
+  map->header.romHash = romHash;
+  map->header.romSize = romSize;
+  map->code.assign((romSize + 7) / 8, 0);
+  map->starts.assign((romSize + 7) / 8, 0);
+}
+
+b8 WriteCodeMap(const CodeMap& map, const char* path){
+  std::ofstream outputFile(path, std::ios::binary);
+  if(!outputFile){
+    std::cerr << "Unable to create code map " << path << std::endl;
+    return false;
+  }
+  outputFile.write((const char*)&map.header, sizeof(map.header));
+  outputFile.write((const char*)map.code.data(), map.code.size());
+  outputFile.write((const char*)map.starts.data(), map.starts.size());
+  if(!outputFile){
+    std::cerr << "Error writing code map " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+b8 ReadCodeMap(CodeMap* map, const char* path){
+  std::ifstream inputFile(path, std::ios::binary);
+  if(!inputFile){
+    std::cerr << "Unable to open code map " << path << std::endl;
+    return false;
+  }
+  if(!inputFile.read((char*)&map->header, sizeof(map->header))
+      || memcmp(map->header.magic, CODE_MAP_MAGIC, sizeof(CODE_MAP_MAGIC)) != 0
+      || map->header.version != CODE_MAP_VERSION
+      || map->header.romSize > RAM_SIZE - ROM_START){
+    std::cerr << "File " << path << " is not a version " << CODE_MAP_VERSION << " code map" << std::endl;
+    return false;
+  }
+  const u32 bitmapSize = (map->header.romSize + 7) / 8;
+  map->code.resize(bitmapSize);
+  map->starts.resize(bitmapSize);
+  if(!inputFile.read((char*)map->code.data(), bitmapSize) || !inputFile.read((char*)map->starts.data(), bitmapSize)){
+    std::cerr << "Code map " << path << " is truncated" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+u32 PrewarmDecoded(Chip8Context& ctx, const CodeMap& map){
+  u32 decoded = 0;
+  for(u32 i = 0; i < map.header.romSize; i++){
+    if(!TestBit(map.starts, i)){
+      continue;
+    }
+    const u16 address = (u16)(ROM_START + i);
+    if(ctx.decoded[address] == UNDECODED){
+      const u16 inst = ((u16)(u8)ctx.ram[address] << 8) | (u8)ctx.ram[(u16)(address + 1)];
+      ctx.decoded[address] = GetOperation(inst, ctx.platform);
+      decoded++;
+    }
+  }
+  return decoded;
+}
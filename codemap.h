@@ -0,0 +1,50 @@
+#pragma once
+#include <vector>
+
+#include "types.h"
+#include "chip8.h"
+
+//Code/data map of a ROM, written by chip8analyze and loaded by chip8 --code-map.
+//
+//Layout: CodeMapHeader, then two bitmaps of (romSize + 7) / 8 bytes each. Bit i stands for address ROM_START + i.
+//  code    the byte is part of an instruction reachable from ROM_START, everything else is data.
+//  starts  an instruction begins at the byte.
+//Code behind computed jumps (BNNN) can't be found statically, header.flags says when the map may be missing some.
+
+constexpr char CODE_MAP_MAGIC[8] = {'C', '8', 'C', 'M', 'A', 'P', '\0', '\0'};
+constexpr u32 CODE_MAP_VERSION = 1;
+enum CodeMapFlags : u32 {
+  CODE_MAP_COMPUTED_JUMPS = 1 << 0,//Has BNNN jumps whose targets weren't followed.
+  CODE_MAP_SELF_MODIFYING = 1 << 1,//Has stores whose target is known to be code.
+};
+
+struct CodeMapHeader{
+  char magic[8];
+  u32 version;
+  u32 flags;
+  u64 romHash;//HashRom() of the ROM the map was made for.
+  u32 romSize;
+  u32 reserved;
+};
+static_assert(sizeof(CodeMapHeader) == 32);
+
+struct CodeMap{
+  CodeMapHeader header;
+  std::vector<u8> code;
+  std::vector<u8> starts;
+};
+
+inline b8 TestBit(const std::vector<u8>& bits, u32 i){
+  return bits[i / 8] & (1 << (i % 8));
+}
+inline void SetBit(std::vector<u8>& bits, u32 i){
+  bits[i / 8] |= 1 << (i % 8);
+}
+
+//Sets up the header and empty bitmaps for a ROM.
+void InitCodeMap(CodeMap* map, u64 romHash, u32 romSize);
+b8 WriteCodeMap(const CodeMap& map, const char* path);
+//Returns false and prints the reason if the file isn't a valid map.
+b8 ReadCodeMap(CodeMap* map, const char* path);
+//Decodes every instruction start into ctx.decoded, the ROM must already be in ram. Returns how many were decoded.
+u32 PrewarmDecoded(Chip8Context& ctx, const CodeMap& map);
@@ -0,0 +1,399 @@
+#include "debugger.h"
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstring>
+
+#if defined(_WIN32)
+  #define WIN32_LEAN_AND_MEAN
+  #define NOMINMAX
+  #include <winsock2.h>
+  #include <ws2tcpip.h>
+  #define CLOSE_SOCKET closesocket
+  constexpr DebugSocket BAD_SOCKET = INVALID_SOCKET;
+#else
+  #include <sys/socket.h>
+  #include <netinet/in.h>
+  #include <arpa/inet.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <errno.h>
+  #define CLOSE_SOCKET close
+  constexpr DebugSocket BAD_SOCKET = -1;
+#endif
+#if !defined(MSG_NOSIGNAL)
+  #define MSG_NOSIGNAL 0
+#endif
+
+static void SetNonBlocking(DebugSocket socket){
+#if defined(_WIN32)
+  u_long enable = 1;
+  ioctlsocket(socket, FIONBIO, &enable);
+#else
+  fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+#endif
+}
+
+static b8 WouldBlock(){
+#if defined(_WIN32)
+  return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+  return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+static std::string Hex(u32 value, u32 digits){
+  std::ostringstream out;
+  out << std::hex << std::uppercase << std::setw(digits) << std::setfill('0') << value;
+  return out.str();
+}
+
+static void Disconnect(Debugger* debugger){
+  CLOSE_SOCKET(debugger->client);
+  debugger->connected = false;
+  debugger->input.clear();
+  debugger->output.clear();
+  std::cout << "debugger: client disconnected" << std::endl;
+}
+
+//A client that stops reading gets dropped once this much is waiting, instead of the queue growing forever.
+constexpr size_t MAX_PENDING_OUTPUT = KB(1024);
+
+//Sends as much of the queued output as the socket takes right now.
+static void Flush(Debugger* debugger){
+  size_t sent = 0;
+  while(debugger->connected && sent < debugger->output.size()){
+    const int n = send(debugger->client, debugger->output.data() + sent, (int)(debugger->output.size() - sent), MSG_NOSIGNAL);
+    if(n > 0){
+      sent += n;
+    }
+    else{
+      if(!WouldBlock()){
+        Disconnect(debugger);
+      }
+      break;
+    }
+  }
+  debugger->output.erase(0, sent);
+}
+
+//Never waits on the client, whatever the socket doesn't take now goes out on a later Flush.
+static void Send(Debugger* debugger, const std::string& text){
+  if(!debugger->connected){
+    return;
+  }
+  debugger->output += text;
+  Flush(debugger);
+  if(debugger->output.size() > MAX_PENDING_OUTPUT){
+    std::cout << "debugger: client isn't reading its replies" << std::endl;
+    Disconnect(debugger);
+  }
+}
+
+static void SendStopped(Debugger* debugger, const Chip8Context& ctx, const std::string& reason){
+  Send(debugger, "stopped " + reason + " pc=0x" + Hex(ctx.PC, 4) + "\n");
+}
+
+b8 StartDebugger(Debugger* debugger, u16 port){
+#if defined(_WIN32)
+  WSADATA wsaData;
+  if(WSAStartup(MAKEWORD(2, 2), &wsaData) != 0){
+    std::cerr << "Unable to initialize Winsock" << std::endl;
+    return false;
+  }
+#endif
+  debugger->listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if(debugger->listener == BAD_SOCKET){
+    std::cerr << "Unable to create debugger socket" << std::endl;
+    return false;
+  }
+  const int reuse = 1;
+  setsockopt(debugger->listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);//Never reachable from another machine.
+  address.sin_port = htons(port);
+  if(bind(debugger->listener, (const sockaddr*)&address, sizeof(address)) != 0 || listen(debugger->listener, 1) != 0){
+    std::cerr << "Unable to listen for a debugger on 127.0.0.1:" << port << std::endl;
+    CLOSE_SOCKET(debugger->listener);
+    return false;
+  }
+  SetNonBlocking(debugger->listener);
+  std::cout << "debugger: listening on 127.0.0.1:" << port << ", paused until it says continue" << std::endl;
+  return true;
+}
+
+void StopDebugger(Debugger* debugger){
+  if(debugger->connected){
+    Disconnect(debugger);
+  }
+  CLOSE_SOCKET(debugger->listener);
+#if defined(_WIN32)
+  WSACleanup();
+#endif
+}
+
+//Parses a number in the given base that must fit in [min, max].
+static b8 ParseNumber(std::istringstream& args, int base, u32 min, u32 max, u32* value){
+  std::string token;
+  if(!(args >> token)){
+    return false;
+  }
+  char* end = nullptr;
+  const unsigned long parsed = strtoul(token.c_str(), &end, base);
+  if(*end != '\0' || parsed < min || parsed > max){
+    return false;
+  }
+  *value = (u32)parsed;
+  return true;
+}
+
+static b8 HasMore(std::istringstream& args){
+  args >> std::ws;
+  return !args.eof();
+}
+
+//Execution picks up at PC. If it is sitting on a breakpoint that breakpoint must not stop it right away again.
+static void Resume(Debugger* debugger, const Chip8Context& ctx){
+  debugger->resumeFrom = ctx.decoded[ctx.PC] == BREAKPOINT ? ctx.PC : -1;
+}
+
+static std::string Disassemble(const Chip8Context& ctx, u16 address, u16* next){
+  const u16 inst = ((u16)(u8)ctx.ram[address] << 8) | (u8)ctx.ram[(u16)(address + 1)];
+  const Operation op = GetOperation(inst, ctx.platform);
+  std::string line = (ctx.decoded[address] == BREAKPOINT ? "*" : " ") + std::string(address == ctx.PC ? ">" : " ");
+  line += "0x" + Hex(address, 4) + "  " + Hex(inst, 4);
+  *next = address + 2;
+  if(op == LONG_I){
+    line += " " + Hex(((u16)(u8)ctx.ram[*next] << 8) | (u8)ctx.ram[(u16)(*next + 1)], 4);
+    *next += 2;
+  }
+  else{
+    line += "     ";
+  }
+  auto name = OperationToString.find(op);
+  return line + "  " + (name != OperationToString.end() ? name->second : "???");
+}
+
+static const char* HELP =
+  "break <addr>               stop before executing addr\n"
+  "delete <addr>              remove the breakpoint at addr\n"
+  "watch r|w|rw <addr> [len]  stop after an instruction reads/writes [addr, addr+len) through I\n"
+  "unwatch <addr>             remove the watchpoints starting at addr\n"
+  "continue                   resume\n"
+  "step [n]                   execute n instructions, 1 by default\n"
+  "pause                      stop\n"
+  "regs | stack | list        show registers, call stack, breakpoints and watchpoints\n"
+  "mem <addr> [len]           hex dump, 16 bytes by default\n"
+  "dis [addr] [n]             disassemble n instructions from addr, 8 from PC by default\n"
+  "addresses are hex, counts decimal\n";
+
+static void RunCommand(Debugger* debugger, Chip8Context& ctx, const std::string& line){
+  std::istringstream args(line);
+  std::string command;
+  if(!(args >> command)){
+    return;
+  }
+  std::ostringstream reply;
+  std::string error;
+  u32 address = 0;
+  u32 count = 0;
+  if(command == "break" || command == "b"){
+    if(!ParseNumber(args, 16, 0, 0xFFFF, &address)){
+      error = "expected an address";
+    }
+    else{
+      ctx.decoded[address] = BREAKPOINT;
+    }
+  }
+  else if(command == "delete" || command == "d"){
+    if(!ParseNumber(args, 16, 0, 0xFFFF, &address)){
+      error = "expected an address";
+    }
+    else if(ctx.decoded[address] != BREAKPOINT){
+      error = "no breakpoint at 0x" + Hex(address, 4);
+    }
+    else{
+      ctx.decoded[address] = UNDECODED;
+      if(debugger->resumeFrom == (i32)address){
+        debugger->resumeFrom = -1;
+      }
+    }
+  }
+  else if(command == "watch" || command == "w"){
+    std::string kind;
+    args >> kind;
+    Watchpoint watchpoint = {};
+    watchpoint.kind = kind == "r" ? WATCH_READ : kind == "w" ? WATCH_WRITE : kind == "rw" ? WATCH_READ | WATCH_WRITE : 0;
+    count = 1;
+    if(!watchpoint.kind){
+      error = "expected r, w or rw";
+    }
+    else if(!ParseNumber(args, 16, 0, 0xFFFF, &address) || (HasMore(args) && !ParseNumber(args, 10, 1, 0xFFFF, &count))){
+      error = "expected an address and an optional length";
+    }
+    else{
+      watchpoint.address = (u16)address;
+      watchpoint.length = (u16)count;
+      debugger->watchpoints.push_back(watchpoint);
+      ctx.watching = true;
+    }
+  }
+  else if(command == "unwatch"){
+    if(!ParseNumber(args, 16, 0, 0xFFFF, &address)){
+      error = "expected an address";
+    }
+    else{
+      std::vector<Watchpoint>& watchpoints = debugger->watchpoints;
+      const size_t before = watchpoints.size();
+      watchpoints.erase(std::remove_if(watchpoints.begin(), watchpoints.end(), [&](const Watchpoint& w){ return w.address == address; }), watchpoints.end());
+      if(watchpoints.size() == before){
+        error = "no watchpoint at 0x" + Hex(address, 4);
+      }
+      ctx.watching = !watchpoints.empty();
+    }
+  }
+  else if(command == "continue" || command == "c"){
+    Resume(debugger, ctx);
+    debugger->paused = false;
+    debugger->steps = 0;
+  }
+  else if(command == "step" || command == "s"){
+    count = 1;
+    if(HasMore(args) && !ParseNumber(args, 10, 1, UINT32_MAX, &count)){
+      error = "expected a step count";
+    }
+    else{
+      Resume(debugger, ctx);
+      debugger->paused = true;
+      debugger->steps = count;
+    }
+  }
+  else if(command == "pause" || command == "p"){
+    debugger->paused = true;
+    debugger->steps = 0;
+    SendStopped(debugger, ctx, "pause");
+  }
+  else if(command == "regs" || command == "r"){
+    reply << "pc=0x" << Hex(ctx.PC, 4) << " i=0x" << Hex(ctx.indexRegister, 4) << " sp=" << ctx.stack.counter
+      << " dt=" << +ctx.delayTimer << " st=" << +ctx.soundTimer << "\n";
+    for(u32 i = 0; i < 16; i++){
+      reply << "v" << Hex(i, 1) << "=" << Hex(ctx.registers[i], 2) << (i % 8 == 7 ? "\n" : " ");
+    }
+  }
+  else if(command == "stack"){
+    for(u32 i = ctx.stack.counter; i > 0; i--){
+      reply << (i - 1) << ": 0x" << Hex(ctx.stack.memory[i - 1], 4) << "\n";
+    }
+  }
+  else if(command == "mem" || command == "m"){
+    count = 16;
+    if(!ParseNumber(args, 16, 0, 0xFFFF, &address) || (HasMore(args) && !ParseNumber(args, 10, 1, RAM_SIZE, &count))){
+      error = "expected an address and an optional length";
+    }
+    for(u32 i = 0; error.empty() && i < count; i++){
+      const u16 at = (u16)(address + i);
+      if(i % 16 == 0){
+        reply << (i ? "\n" : "") << "0x" << Hex(at, 4) << ":";
+      }
+      reply << " " << Hex((u8)ctx.ram[at], 2);
+    }
+    reply << (error.empty() ? "\n" : "");
+  }
+  else if(command == "dis"){
+    address = ctx.PC;
+    count = 8;
+    if((HasMore(args) && !ParseNumber(args, 16, 0, 0xFFFF, &address)) || (HasMore(args) && !ParseNumber(args, 10, 1, 4096, &count))){
+      error = "expected an optional address and count";
+    }
+    u16 next = (u16)address;
+    for(u32 i = 0; error.empty() && i < count; i++){
+      reply << Disassemble(ctx, next, &next) << "\n";
+    }
+  }
+  else if(command == "list" || command == "l"){
+    for(u32 i = 0; i < RAM_SIZE; i++){
+      if(ctx.decoded[i] == BREAKPOINT){
+        reply << "break 0x" << Hex(i, 4) << "\n";
+      }
+    }
+    for(const Watchpoint& w : debugger->watchpoints){
+      reply << "watch " << (w.kind & WATCH_READ ? "r" : "") << (w.kind & WATCH_WRITE ? "w" : "") << " 0x" << Hex(w.address, 4) << " " << w.length << "\n";
+    }
+  }
+  else if(command == "help" || command == "h"){
+    reply << HELP;
+  }
+  else{
+    error = "unknown command " + command + ", try help";
+  }
+  Send(debugger, error.empty() ? reply.str() + "ok\n" : "error: " + error + "\n");
+}
+
+void PollDebugger(Debugger* debugger, Chip8Context& ctx){
+  if(!debugger->connected){
+    const DebugSocket client = accept(debugger->listener, nullptr, nullptr);
+    if(client == BAD_SOCKET){
+      return;
+    }
+    SetNonBlocking(client);
+    debugger->client = client;
+    debugger->connected = true;
+    std::cout << "debugger: client connected" << std::endl;
+    Send(debugger, "chip8 debugger, type help for commands\n");
+    if(debugger->paused){
+      SendStopped(debugger, ctx, "pause");
+    }
+  }
+  char buffer[512];
+  while(debugger->connected){
+    const int n = recv(debugger->client, buffer, sizeof(buffer), 0);
+    if(n > 0){
+      debugger->input.append(buffer, n);
+    }
+    else{
+      if(n == 0 || !WouldBlock()){
+        Disconnect(debugger);
+      }
+      break;
+    }
+  }
+  size_t newline;
+  while(debugger->connected && (newline = debugger->input.find('\n')) != std::string::npos){
+    std::string line = debugger->input.substr(0, newline);
+    debugger->input.erase(0, newline + 1);
+    if(!line.empty() && line.back() == '\r'){
+      line.pop_back();
+    }
+    RunCommand(debugger, ctx, line);
+  }
+}
+
+void DebuggerFrameEnd(Debugger* debugger, Chip8Context& ctx){
+  Flush(debugger);
+  if(ctx.stop){
+    ctx.stop = false;
+    debugger->paused = true;
+    debugger->steps = 0;
+    SendStopped(debugger, ctx, debugger->stopReason);
+  }
+  else if(debugger->paused && debugger->steps > 0){
+    debugger->steps -= std::min(debugger->steps, ctx.instructionsPerformed);
+    if(debugger->steps == 0){
+      SendStopped(debugger, ctx, "step");
+    }
+  }
+}
+
+void CheckWatchpoints(Chip8Context& ctx, u16 address, u32 length, WatchKind kind){
+  for(const Watchpoint& w : ctx.debugger->watchpoints){
+    //Overlap of [address, address + length) and the watched range, both can wrap around the 64KB address space.
+    if((w.kind & kind) && ((u16)(w.address - address) < length || (u16)(address - w.address) < w.length)){
+      ctx.debugger->stopReason = std::string("watch ") + (kind == WATCH_READ ? "read" : "write") + " 0x" + Hex(w.address, 4);
+      ctx.stop = true;
+      return;
+    }
+  }
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "chip8.h"
+
+//Debugger with a line protocol on a loopback TCP port, e.g. `nc 127.0.0.1 <port>`.
+//Breakpoints patch Chip8Context::decoded with BREAKPOINT, so only their own addresses leave the normal
+//dispatch. Watchpoints are checked by the memory instructions, and only while ctx.watching is set.
+//
+//Commands, addresses in hex and counts in decimal. Every reply ends with "ok" or "error: <reason>".
+//  break <addr>                 delete <addr>
+//  watch r|w|rw <addr> [len]    unwatch <addr>
+//  continue    step [n]    pause
+//  regs    stack    mem <addr> [len]    dis [addr] [n]    list    help
+//Whenever execution stops the client gets "stopped <reason> pc=<addr>".
+
+enum WatchKind : u8 {
+  WATCH_READ = 1,
+  WATCH_WRITE = 2,
+};
+
+struct Watchpoint{
+  u16 address;
+  u16 length;
+  u8 kind;
+};
+
+#if defined(_WIN32)
+typedef uintptr_t DebugSocket;//SOCKET without pulling in winsock2.h
+#else
+typedef int DebugSocket;
+#endif
+
+struct Debugger{
+  DebugSocket listener;
+  DebugSocket client;
+  b8 connected = false;
+  std::string input;//Partial command line received so far.
+  std::string output;//Replies the socket didn't take yet, flushed every frame.
+  std::vector<Watchpoint> watchpoints;
+  b8 paused = true;//Starts paused so breakpoints can be set before the ROM runs.
+  u32 steps = 0;//Instructions left to single step while paused.
+  i32 resumeFrom = -1;//Breakpoint address to execute once instead of stopping on, set when resuming from it.
+  std::string stopReason;
+};
+
+//Returns false and prints the reason if the port can't be opened.
+b8 StartDebugger(Debugger* debugger, u16 port);
+void StopDebugger(Debugger* debugger);
+//Accepts a client and runs the commands it sent since the last call. Never blocks.
+void PollDebugger(Debugger* debugger, Chip8Context& ctx);
+//How many instructions the next frame may run.
+inline u32 DebuggerBudget(const Debugger* debugger, u32 cyclesPerFrame){
+  if(!debugger->paused){
+    return cyclesPerFrame;
+  }
+  return debugger->steps < cyclesPerFrame ? debugger->steps : cyclesPerFrame;
+}
+//Called after every frame, reports a stop or a finished step and sends what's left of the replies.
+void DebuggerFrameEnd(Debugger* debugger, Chip8Context& ctx);
+//Stops execution after the current instruction if [address, address + length) overlaps a watchpoint of that kind.
+void CheckWatchpoints(Chip8Context& ctx, u16 address, u32 length, WatchKind kind);
@@ -0,0 +1,39 @@
+#pragma once
+#include "types.h"
+
+// Screen dimensions
+const u8 CHIP8_DISPLAY_WIDTH = 64;
+const u8 CHIP8_DISPLAY_HEIGHT = 32;
+//SUPER-CHIP/XO-CHIP hi-res mode doubles both axes.
+const u8 CHIP8_HIRES_DISPLAY_WIDTH = 128;
+const u8 CHIP8_HIRES_DISPLAY_HEIGHT = 64;
+const int SCREEN_WIDTH = 8*CHIP8_DISPLAY_WIDTH;
+const int SCREEN_HEIGHT = 8*CHIP8_DISPLAY_HEIGHT;
+//The display is stored as packed bitplanes, one bit per pixel with the leftmost pixel in the most significant bit.
+//A hi-res row takes two words, a lo-res row only uses the first one, so draws and scrolls are word-wide shifts.
+constexpr u32 DISPLAY_PLANES = 2;
+constexpr u32 DISPLAY_WORDS_PER_ROW = CHIP8_HIRES_DISPLAY_WIDTH / 64;
+typedef u64 DisplayPlanes[DISPLAY_PLANES][CHIP8_HIRES_DISPLAY_HEIGHT][DISPLAY_WORDS_PER_ROW];
+
+//Colors for (plane 2 << 1 | plane 1), ARGB8888.
+constexpr u32 PALETTE[1 << DISPLAY_PLANES] = {0xFF000000, 0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555};
+
+//Expands the packed planes into one palette index per pixel at hi-res size; lo-res pixels are doubled.
+inline void ExpandDisplay(const DisplayPlanes& display, b8 hires, u8 out[CHIP8_HIRES_DISPLAY_HEIGHT][CHIP8_HIRES_DISPLAY_WIDTH])
+{
+  const u32 scale = hires ? 1 : 2;
+  const u32 width = hires ? CHIP8_HIRES_DISPLAY_WIDTH : CHIP8_DISPLAY_WIDTH;
+  const u32 height = hires ? CHIP8_HIRES_DISPLAY_HEIGHT : CHIP8_DISPLAY_HEIGHT;
+  for(u32 row = 0; row < height; ++row){
+    for(u32 column = 0; column < width; ++column){
+      const u32 word = column / 64;
+      const u32 bit = 63 - column % 64;
+      const u8 color = ((display[0][row][word] >> bit) & 1) | (((display[1][row][word] >> bit) & 1) << 1);
+      for(u32 dy = 0; dy < scale; dy++){
+        for(u32 dx = 0; dx < scale; dx++){
+          out[row*scale + dy][column*scale + dx] = color;
+        }
+      }
+    }
+  }
+}
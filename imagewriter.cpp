@@ -0,0 +1,381 @@
+#include "imagewriter.h"
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+//---- Deflate (RFC 1951), single block with the fixed Huffman codes
+
+namespace {
+struct BitWriter{
+  std::vector<u8>& out;
+  u32 buffer = 0;
+  u32 count = 0;
+  //Bits go out least significant first, as both deflate and GIF's LZW want them.
+  void Write(u32 bits, u32 length){
+    buffer |= bits << count;
+    count += length;
+    while(count >= 8){
+      out.push_back((u8)buffer);
+      buffer >>= 8;
+      count -= 8;
+    }
+  }
+  void Flush(){
+    if(count){
+      out.push_back((u8)buffer);
+    }
+    buffer = 0;
+    count = 0;
+  }
+};
+}
+
+constexpr u16 LENGTH_BASE[] = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258};
+constexpr u8 LENGTH_EXTRA[] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+constexpr u16 DISTANCE_BASE[] = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+constexpr u8 DISTANCE_EXTRA[] = {0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+constexpr u32 DEFLATE_WINDOW = 32768;
+constexpr u32 MIN_MATCH = 3;
+constexpr u32 MAX_MATCH = 258;
+constexpr u32 MAX_CHAIN = 32;
+constexpr u32 HASH_BITS = 15;
+
+//Huffman codes are defined most significant bit first but packed least significant first.
+static u32 ReverseBits(u32 code, u32 length){
+  u32 result = 0;
+  for(u32 i = 0; i < length; i++){
+    result = (result << 1) | ((code >> i) & 1);
+  }
+  return result;
+}
+
+static void WriteSymbol(BitWriter& bits, u32 symbol){
+  if(symbol < 144){
+    bits.Write(ReverseBits(0x30 + symbol, 8), 8);
+  }
+  else if(symbol < 256){
+    bits.Write(ReverseBits(0x190 + symbol - 144, 9), 9);
+  }
+  else if(symbol < 280){
+    bits.Write(ReverseBits(symbol - 256, 7), 7);
+  }
+  else{
+    bits.Write(ReverseBits(0xC0 + symbol - 280, 8), 8);
+  }
+}
+
+static void WriteMatch(BitWriter& bits, u32 length, u32 distance){
+  u32 lengthCode = sizeof(LENGTH_BASE)/sizeof(LENGTH_BASE[0]) - 1;
+  while(LENGTH_BASE[lengthCode] > length){
+    lengthCode--;
+  }
+  WriteSymbol(bits, 257 + lengthCode);
+  bits.Write(length - LENGTH_BASE[lengthCode], LENGTH_EXTRA[lengthCode]);
+  u32 distanceCode = sizeof(DISTANCE_BASE)/sizeof(DISTANCE_BASE[0]) - 1;
+  while(DISTANCE_BASE[distanceCode] > distance){
+    distanceCode--;
+  }
+  bits.Write(ReverseBits(distanceCode, 5), 5);
+  bits.Write(distance - DISTANCE_BASE[distanceCode], DISTANCE_EXTRA[distanceCode]);
+}
+
+static u32 Adler32(const u8* data, size_t size){
+  u32 a = 1, b = 0;
+  for(size_t i = 0; i < size; i++){
+    a = (a + data[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  return (b << 16) | a;
+}
+
+std::vector<u8> ZlibCompress(const u8* data, size_t size){
+  std::vector<u8> out = {0x78, 0x01};
+  BitWriter bits{out};
+  bits.Write(1, 1);//BFINAL
+  bits.Write(1, 2);//BTYPE fixed Huffman
+  std::vector<i32> head(1 << HASH_BITS, -1);
+  std::vector<i32> previous(DEFLATE_WINDOW, -1);
+  auto hash = [&](size_t i){ return ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & ((1 << HASH_BITS) - 1); };
+  auto insert = [&](size_t i){
+    if(i + MIN_MATCH <= size){
+      const u32 h = hash(i);
+      previous[i % DEFLATE_WINDOW] = head[h];
+      head[h] = (i32)i;
+    }
+  };
+  size_t i = 0;
+  while(i < size){
+    u32 bestLength = 0;
+    u32 bestDistance = 0;
+    if(i + MIN_MATCH <= size){
+      const u32 maxLength = (u32)std::min<size_t>(MAX_MATCH, size - i);
+      i32 candidate = head[hash(i)];
+      for(u32 chain = 0; chain < MAX_CHAIN && candidate >= 0 && i - candidate <= DEFLATE_WINDOW; chain++){
+        u32 length = 0;
+        while(length < maxLength && data[candidate + length] == data[i + length]){
+          length++;
+        }
+        if(length > bestLength){
+          bestLength = length;
+          bestDistance = (u32)(i - candidate);
+          if(length == maxLength){
+            break;
+          }
+        }
+        const i32 next = previous[candidate % DEFLATE_WINDOW];
+        if(next >= candidate){
+          break;
+        }
+        candidate = next;
+      }
+    }
+    if(bestLength >= MIN_MATCH){
+      WriteMatch(bits, bestLength, bestDistance);
+      for(u32 j = 0; j < bestLength; j++){
+        insert(i + j);
+      }
+      i += bestLength;
+    }
+    else{
+      WriteSymbol(bits, data[i]);
+      insert(i);
+      i++;
+    }
+  }
+  WriteSymbol(bits, 256);//End of block
+  bits.Flush();
+  const u32 adler = Adler32(data, size);
+  out.push_back((u8)(adler >> 24));
+  out.push_back((u8)(adler >> 16));
+  out.push_back((u8)(adler >> 8));
+  out.push_back((u8)adler);
+  return out;
+}
+
+//---- APNG
+
+static u32 Crc32(const u8* data, size_t size, u32 crc = 0){
+  static u32 table[256];
+  if(!table[1]){
+    for(u32 n = 0; n < 256; n++){
+      u32 c = n;
+      for(u32 k = 0; k < 8; k++){
+        c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      }
+      table[n] = c;
+    }
+  }
+  crc = ~crc;
+  for(size_t i = 0; i < size; i++){
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+static void PutU32(std::vector<u8>& out, u32 value){
+  out.push_back((u8)(value >> 24));
+  out.push_back((u8)(value >> 16));
+  out.push_back((u8)(value >> 8));
+  out.push_back((u8)value);
+}
+
+static void PutU16(std::vector<u8>& out, u16 value){
+  out.push_back((u8)(value >> 8));
+  out.push_back((u8)value);
+}
+
+static void WriteChunk(std::ofstream& file, const char type[4], const std::vector<u8>& data){
+  std::vector<u8> chunk;
+  PutU32(chunk, (u32)data.size());
+  chunk.insert(chunk.end(), type, type + 4);
+  chunk.insert(chunk.end(), data.begin(), data.end());
+  PutU32(chunk, Crc32(chunk.data() + 4, chunk.size() - 4));
+  file.write((const char*)chunk.data(), chunk.size());
+}
+
+static std::vector<u8> AnimationControl(u32 frames){
+  std::vector<u8> data;
+  PutU32(data, frames);
+  PutU32(data, 0);//Loop forever
+  return data;
+}
+
+b8 ApngBegin(ApngWriter* apng, const char* path, u32 width, u32 height, const u32* palette, u32 paletteSize){
+  apng->file.open(path, std::ios::binary);
+  if(!apng->file){
+    std::cerr << "Unable to create " << path << std::endl;
+    return false;
+  }
+  apng->width = width;
+  apng->height = height;
+  constexpr u8 SIGNATURE[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  apng->file.write((const char*)SIGNATURE, sizeof(SIGNATURE));
+  std::vector<u8> header;
+  PutU32(header, width);
+  PutU32(header, height);
+  header.insert(header.end(), {8, 3, 0, 0, 0});//8 bit palette indices, no interlacing
+  WriteChunk(apng->file, "IHDR", header);
+  apng->animationControl = apng->file.tellp();
+  WriteChunk(apng->file, "acTL", AnimationControl(0));
+  std::vector<u8> colors;
+  for(u32 i = 0; i < paletteSize; i++){
+    colors.insert(colors.end(), {(u8)(palette[i] >> 16), (u8)(palette[i] >> 8), (u8)palette[i]});
+  }
+  WriteChunk(apng->file, "PLTE", colors);
+  return (b8)apng->file;
+}
+
+b8 ApngAddFrame(ApngWriter* apng, const u8* pixels, u16 delayNumerator, u16 delayDenominator){
+  std::vector<u8> control;
+  PutU32(control, apng->sequence++);
+  PutU32(control, apng->width);
+  PutU32(control, apng->height);
+  PutU32(control, 0);
+  PutU32(control, 0);
+  PutU16(control, delayNumerator);
+  PutU16(control, delayDenominator);
+  control.insert(control.end(), {0, 0});//APNG_DISPOSE_OP_NONE, APNG_BLEND_OP_SOURCE
+  WriteChunk(apng->file, "fcTL", control);
+
+  std::vector<u8> raw;
+  raw.reserve((size_t)(apng->width + 1) * apng->height);
+  for(u32 row = 0; row < apng->height; row++){
+    raw.push_back(0);//Filter: none
+    raw.insert(raw.end(), pixels + (size_t)row * apng->width, pixels + (size_t)(row + 1) * apng->width);
+  }
+  std::vector<u8> compressed = ZlibCompress(raw.data(), raw.size());
+  if(apng->frames == 0){
+    WriteChunk(apng->file, "IDAT", compressed);
+  }
+  else{
+    std::vector<u8> data;
+    PutU32(data, apng->sequence++);
+    data.insert(data.end(), compressed.begin(), compressed.end());
+    WriteChunk(apng->file, "fdAT", data);
+  }
+  apng->frames++;
+  return (b8)apng->file;
+}
+
+b8 ApngEnd(ApngWriter* apng){
+  WriteChunk(apng->file, "IEND", {});
+  apng->file.seekp(apng->animationControl);
+  WriteChunk(apng->file, "acTL", AnimationControl(apng->frames));
+  apng->file.close();
+  return !apng->file.fail();
+}
+
+//---- PNG
+
+b8 WritePng(const char* path, const u32* pixels, u32 width, u32 height){
+  std::ofstream file(path, std::ios::binary);
+  if(!file){
+    std::cerr << "Unable to create " << path << std::endl;
+    return false;
+  }
+  constexpr u8 SIGNATURE[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  file.write((const char*)SIGNATURE, sizeof(SIGNATURE));
+  std::vector<u8> header;
+  PutU32(header, width);
+  PutU32(header, height);
+  header.insert(header.end(), {8, 2, 0, 0, 0});//8 bit RGB, no interlacing
+  WriteChunk(file, "IHDR", header);
+  std::vector<u8> raw;
+  raw.reserve((size_t)(width * 3 + 1) * height);
+  for(u32 row = 0; row < height; row++){
+    //Filter: up for every row but the first. Scaled images repeat rows, those become all zeros.
+    raw.push_back(row ? 2 : 0);
+    for(u32 column = 0; column < width; column++){
+      const u32 color = pixels[(size_t)row * width + column];
+      const u32 above = row ? pixels[(size_t)(row - 1) * width + column] : 0;
+      raw.insert(raw.end(), {(u8)((color >> 16) - (above >> 16)), (u8)((color >> 8) - (above >> 8)), (u8)(color - above)});
+    }
+  }
+  WriteChunk(file, "IDAT", ZlibCompress(raw.data(), raw.size()));
+  WriteChunk(file, "IEND", {});
+  return (b8)file;
+}
+
+//---- GIF
+
+b8 GifBegin(GifWriter* gif, const char* path, u32 width, u32 height, const u32* palette, u32 paletteSize){
+  gif->file.open(path, std::ios::binary);
+  if(!gif->file){
+    std::cerr << "Unable to create " << path << std::endl;
+    return false;
+  }
+  gif->width = width;
+  gif->height = height;
+  gif->minCodeSize = 2;
+  while((1u << gif->minCodeSize) < paletteSize){
+    gif->minCodeSize++;
+  }
+  std::vector<u8> out = {'G', 'I', 'F', '8', '9', 'a'};
+  out.insert(out.end(), {(u8)width, (u8)(width >> 8), (u8)height, (u8)(height >> 8)});
+  out.insert(out.end(), {(u8)(0x80 | ((gif->minCodeSize - 1) << 4) | (gif->minCodeSize - 1)), 0, 0});
+  for(u32 i = 0; i < (1u << gif->minCodeSize); i++){
+    const u32 color = i < paletteSize ? palette[i] : 0;
+    out.insert(out.end(), {(u8)(color >> 16), (u8)(color >> 8), (u8)color});
+  }
+  const u8 LOOP[] = {0x21, 0xFF, 0x0B, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 0x03, 0x01, 0x00, 0x00, 0x00};
+  out.insert(out.end(), LOOP, LOOP + sizeof(LOOP));
+  gif->file.write((const char*)out.data(), out.size());
+  return (b8)gif->file;
+}
+
+//LZW with a flat dictionary indexed by (prefix code, next pixel), small palettes keep it tiny.
+static void GifCompress(const u8* pixels, size_t count, u32 minCodeSize, std::vector<u8>& out){
+  const u32 clearCode = 1 << minCodeSize;
+  const u32 endCode = clearCode + 1;
+  std::vector<u16> dictionary(4096 << minCodeSize, 0);
+  BitWriter bits{out};
+  u32 codeSize = minCodeSize + 1;
+  u32 lastCode = endCode;
+  bits.Write(clearCode, codeSize);
+  u32 prefix = pixels[0];
+  for(size_t i = 1; i < count; i++){
+    const u32 key = (prefix << minCodeSize) | pixels[i];
+    if(dictionary[key]){
+      prefix = dictionary[key];
+      continue;
+    }
+    bits.Write(prefix, codeSize);
+    dictionary[key] = (u16)++lastCode;
+    if(lastCode >= (1u << codeSize)){
+      codeSize++;
+    }
+    if(lastCode == 4095){
+      bits.Write(clearCode, codeSize);
+      std::fill(dictionary.begin(), dictionary.end(), 0);
+      codeSize = minCodeSize + 1;
+      lastCode = endCode;
+    }
+    prefix = pixels[i];
+  }
+  bits.Write(prefix, codeSize);
+  bits.Write(endCode, codeSize);
+  bits.Flush();
+}
+
+b8 GifAddFrame(GifWriter* gif, const u8* pixels, u16 delayCentiseconds){
+  std::vector<u8> out = {0x21, 0xF9, 0x04, 0x04, (u8)delayCentiseconds, (u8)(delayCentiseconds >> 8), 0x00, 0x00};//Disposal: leave in place
+  out.insert(out.end(), {0x2C, 0, 0, 0, 0, (u8)gif->width, (u8)(gif->width >> 8), (u8)gif->height, (u8)(gif->height >> 8), 0});
+  out.push_back((u8)gif->minCodeSize);
+  std::vector<u8> compressed;
+  GifCompress(pixels, (size_t)gif->width * gif->height, gif->minCodeSize, compressed);
+  for(size_t i = 0; i < compressed.size(); i += 255){
+    const size_t block = std::min<size_t>(255, compressed.size() - i);
+    out.push_back((u8)block);
+    out.insert(out.end(), compressed.begin() + i, compressed.begin() + i + block);
+  }
+  out.push_back(0);
+  gif->file.write((const char*)out.data(), out.size());
+  return (b8)gif->file;
+}
+
+b8 GifEnd(GifWriter* gif){
+  gif->file.put(0x3B);
+  gif->file.close();
+  return !gif->file.fail();
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <fstream>
+#include <vector>
+
+#include "types.h"
+
+//Minimal GIF, APNG and PNG encoders, no external dependencies.
+//Palettes are ARGB8888 like PALETTE, palette pixels are one index per byte.
+
+struct GifWriter{
+  std::ofstream file;
+  u32 width = 0;
+  u32 height = 0;
+  u32 minCodeSize = 2;
+};
+b8 GifBegin(GifWriter* gif, const char* path, u32 width, u32 height, const u32* palette, u32 paletteSize);
+b8 GifAddFrame(GifWriter* gif, const u8* pixels, u16 delayCentiseconds);
+b8 GifEnd(GifWriter* gif);
+
+struct ApngWriter{
+  std::ofstream file;
+  u32 width = 0;
+  u32 height = 0;
+  u32 sequence = 0;
+  u32 frames = 0;
+  std::streampos animationControl;//acTL gets patched with the frame count at the end.
+};
+b8 ApngBegin(ApngWriter* apng, const char* path, u32 width, u32 height, const u32* palette, u32 paletteSize);
+//Shows the frame for delayNumerator/delayDenominator seconds.
+b8 ApngAddFrame(ApngWriter* apng, const u8* pixels, u16 delayNumerator, u16 delayDenominator);
+b8 ApngEnd(ApngWriter* apng);
+
+//Single truecolor PNG from ARGB8888 pixels, alpha is dropped.
+b8 WritePng(const char* path, const u32* pixels, u32 width, u32 height);
+
+//zlib stream (RFC 1950) using fixed Huffman codes and greedy LZ77 matching, plenty for flat emulator frames.
+std::vector<u8> ZlibCompress(const u8* data, size_t size);
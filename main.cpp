@@ -9,24 +9,26 @@
 #include <cstdint>
 #include <string>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <vector>
+#include <algorithm>
 #include <math.h>
 #include <assert.h>
+#include <filesystem>
 
+#include "types.h"
+#include "display.h"
+#include "chip8.h"
+#include "rompack.h"
+#include "capture.h"
+#include "debugger.h"
+#include "codemap.h"
+#include "scaler.h"
+#include "imagewriter.h"
 
 
-typedef int8_t   i8;
-typedef int16_t  i16;
-typedef int32_t  i32;
-typedef int64_t  i64;
-typedef uint8_t  u8;
-typedef uint16_t u16;
-typedef uint32_t u32;
-typedef uint64_t u64;
-typedef float f32;
-typedef double f64;
-typedef bool b8;
 std::vector<char> LoadROM(const char* path){
     std::ifstream inputFile(path, std::ios::binary);
     if (!inputFile){
@@ -48,85 +50,7 @@ std::vector<char> LoadROM(const char* path){
     }
 }
 //
-// Screen dimensions
-const u8 CHIP8_DISPLAY_WIDTH = 64;
-const u8 CHIP8_DISPLAY_HEIGHT = 32;
-const int SCREEN_WIDTH = 8*CHIP8_DISPLAY_WIDTH;
-const int SCREEN_HEIGHT = 8*CHIP8_DISPLAY_HEIGHT;
-
 #define MEM_ALLOC_ERR() std::cerr << "Could not allocate memory! Quitting..."; exit(1);
-//
-//NOTE 1KB? maybe we'll need more? who knows.
-#define STACK_SIZE 1024 
-struct Stack{
-  u16 memory[STACK_SIZE];
-  u32 counter = 0;
-  void Push(u16 address){
-    assert(counter < STACK_SIZE);
-    memory[counter++] = address;
-  }
-  u16 Pop(){
-    if(counter > 0){
-      return memory[--counter];
-    }
-    return 0;
-  }
-};
-struct Chip8Context {
-	i8 *ram;
-	b8 display[CHIP8_DISPLAY_HEIGHT][CHIP8_DISPLAY_WIDTH];
-	u16 PC;
-	u16 indexRegister;
-  Stack stack;
-	u8 delayTimer;
-	u8 soundTimer;
-	union {
-		struct {
-			u8 V0;
-			u8 V1;
-			u8 V2;
-			u8 V3;
-			u8 V4;
-			u8 V5;
-			u8 V6;
-			u8 V7;
-			u8 V8;
-			u8 V9;
-			u8 VA;
-			u8 VB;
-			u8 VC;
-			u8 VD;
-			u8 VE;
-			u8 VF;
-		};
-		u8 registers[16];
-	};
-	union{
-		struct{
-			b8 btn0;
-			b8 btn1;
-			b8 btn2;
-			b8 btn3;
-			b8 btn4;
-			b8 btn5;
-			b8 btn6;
-			b8 btn7;
-			b8 btn8;
-			b8 btn9;
-			b8 btnA;
-			b8 btnB;
-			b8 btnC;
-			b8 btnD;
-			b8 btnE;
-			b8 btnF;
-		};
-		b8 buttons[16];
-	};
-  u32 instructionsPerformed = 0;
-  b8 getKey = false;
-  u8 getKeyPressed = 0xFF;
-};
-
 constexpr u32 BYTES_PER_FONT = 5;
 constexpr u8 FONT[] = {
   0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
@@ -146,17 +70,44 @@ constexpr u8 FONT[] = {
   0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
   0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
+//SUPER-CHIP 8x10 digits for FX30, XO-CHIP adds A-F.
+constexpr u32 BYTES_PER_BIG_FONT = 10;
+constexpr u32 BIG_FONT_OFFSET = sizeof(FONT);
+constexpr u8 BIG_FONT[] = {
+  0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+  0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+  0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+  0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+  0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+  0x3E, 0x7C, 0xE0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+  0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+  0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+  0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+  0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+  0xFE, 0xFF, 0xC3, 0xC3, 0xFE, 0xFE, 0xC3, 0xC3, 0xFF, 0xFE, // B
+  0x3C, 0x7E, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0x7E, 0x3C, // C
+  0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+//Clears the selected planes only, XO-CHIP relies on that to keep a static background on the other plane.
 void ClearDisplay(Chip8Context* ctx){
-  for(u32 i = 0; i < CHIP8_DISPLAY_HEIGHT; i++)
-    for(u32 j = 0; j < CHIP8_DISPLAY_WIDTH; j++)
-      ctx->display[i][j] = false;
+  for(u32 plane = 0; plane < DISPLAY_PLANES; plane++){
+    if(ctx->planeMask & (1 << plane)){
+      memset(ctx->display[plane], 0, sizeof(ctx->display[plane]));
+    }
+  }
+  ctx->displayDirty = true;
 }
-// #define RAM_SIZE 4096
-#define KB(n) (n)*1024
-#define RAM_SIZE KB(4)
-void InitChip8Context(Chip8Context* ctx){
+void SetHires(Chip8Context* ctx, b8 hires){
+  ctx->hires = hires;
+  memset(ctx->display, 0, sizeof(ctx->display));
+  ctx->displayDirty = true;
+}
+void InitChip8Context(Chip8Context* ctx, const PlatformProfile* platform){
 	//Allocate memory for ram
-	ctx->ram = (i8*)malloc(RAM_SIZE);
+	ctx->ram = (i8*)calloc(RAM_SIZE, 1);
 	if(!ctx->ram) {
 		MEM_ALLOC_ERR();
 	}
@@ -164,297 +115,147 @@ void InitChip8Context(Chip8Context* ctx){
   for(u32 i = 0; i < sizeof(FONT)/sizeof(FONT[0]); i++){
     ctx->ram[i] = FONT[i];
   }
-	ctx->PC = 0x200;
+  for(u32 i = 0; i < sizeof(BIG_FONT)/sizeof(BIG_FONT[0]); i++){
+    ctx->ram[BIG_FONT_OFFSET + i] = BIG_FONT[i];
+  }
+  ctx->decoded = (Operation*)malloc(RAM_SIZE * sizeof(Operation));
+  if(!ctx->decoded) {
+    MEM_ALLOC_ERR();
+  }
+  std::fill_n(ctx->decoded, RAM_SIZE, UNDECODED);
+	ctx->PC = ROM_START;
+  ctx->platform = platform;
 }
 
-constexpr u16 OP_MASK = 15 << 12;
-constexpr u16 X_MASK = 15 << 8;
-constexpr u16 Y_MASK = 15 << 4;
-constexpr u16 N_MASK = 15 << 0;
-constexpr u16 NN_MASK = 255 << 0;
-constexpr u16 NNN_MASK = 4095;
-
-#define MASK_OP(inst) (((inst) & OP_MASK) >> 12)
-#define MASK_X(inst) (((inst) & X_MASK) >> 8)
-#define MASK_Y(inst) (((inst) & Y_MASK) >> 4)
-#define MASK_N(inst) (((inst) & N_MASK) >> 0)
-#define MASK_NN(inst) (((inst) & NN_MASK) >> 0)
-#define MASK_NNN(inst) (u16)(((inst) & NNN_MASK) >> 0)
-
-
-enum Operation {
-	CLS = 0x00E0,
-  RET = 0x00EE,
-	JP = 0x1000,
-  CALL = 0x2000,
-  SE_IMM = 0x3000,
-  SNE_IMM = 0x4000,
-  SE_REG = 0x5000,
-  SNE_REG = 0x9000,
-	LDX_IMM = 0x6000,
-  LDX_REG = 0x8000,
-  ORX_REG = 0x8001,
-  ANDX_REG = 0x8002,
-  XORX_REG = 0x8003,
-	ADDX_REG = 0x8004,
-  SUB_REG = 0x8005,
-  SUBN_REG = 0x8007,
-  /*NOTE: shifting are ambiguous instructions: 
-  the CHIP-8 interpreter for the original COSMAC VIP, this instruction did the following: It put the value of VY into VX, and then shifted the value in VX 1 bit to the right (8XY6) or left (8XYE). VY was not affected, but the flag register VF would be set to the bit that was shifted out.
-  However, starting with CHIP-48 and SUPER-CHIP in the early 1990s, these instructions were changed so that they shifted VX in place, and ignored the Y completely.
-  
-  This is one of the main differences between implementations that cause problems for programs. Since different games expect different behavior, you could consider making the behavior configurable by the user.*/
-  SHR = 0x8006,
-  SHL = 0x800E,
-	ADDX_IMM = 0x7000,
-	SETI = 0xA000,
-  /*Ambiguous instruction!
-  In the original COSMAC VIP interpreter, this instruction jumped to the address NNN plus the value in the register V0. This was mainly used for “jump tables”, to quickly be able to jump to different subroutines based on some input.
-  Starting with CHIP-48 and SUPER-CHIP, it was (probably unintentionally) changed to work as BXNN: It will jump to the address XNN, plus the value in the register VX. So the instruction B220 will jump to address 220 plus the value in the register V2.
-  The BNNN instruction was not widely used, so you might be able to just implement the first behavior (if you pick one, that’s definitely the one to go with). If you want to support a wide range of CHIP-8 programs, make this “quirk” configurable.*/
-  JPOFFSET = 0xB000,//TODO: I can try to configure this later on, supposedly the instruction is not widely used.
-  RND = 0xC000,
-  //Skip if de/pressed
-  SKP = 0xE09E,
-  SKNP = 0xE0A1,
-	DRAW = 0xD000,
-  //Timers
-  LDX_TIMER = 0xF007,
-  LD_DT = 0xF015,//Load delay timer
-  LD_ST = 0xF018,//Load sound timer
-  ADDI_X = 0xF01E,//Unlike other arithmetic instructions, this did not affect VF on overflow on the original COSMAC VIP. However, it seems that some interpreters set VF to 1 if I “overflows” from 0FFF to above 1000 (outside the normal addressing range). This wasn’t the case on the original COSMAC VIP, at least, but apparently the CHIP-8 interpreter for Amiga behaved this way. At least one known game, Spacefight 2091!, relies on this behavior. I don’t know of any games that rely on this not happening, so perhaps it’s safe to do it like the Amiga interpreter did.
-  LD_KEY = 0xF00A,
-  LD_FONT = 0xF029,//Load I register with the address of font for character in X
-  BCD = 0xF033,
-
-
-
-
-  /*
-  * Ambiguous instruction!
-  *
-  * These two instructions store registers to memory, or load them from memory, respectively.
-  *
-  * For FX55, the value of each variable register from V0 to VX inclusive (if X is 0, then only V0) will be stored in successive memory addresses, starting with the one that’s stored in I. V0 will be stored at the address in I, V1 will be stored in I + 1, and so on, until VX is stored in I + X.
-*
-* FX65 does the opposite; it takes the value stored at the memory addresses and loads them into the variable registers instead.
-*
-* The original CHIP-8 interpreter for the COSMAC VIP actually incremented the I register while it worked. Each time it stored or loaded one register, it incremented I. After the instruction was finished, I would end up being set to the new value I + X + 1.
-*
-* However, modern interpreters (starting with CHIP48 and SUPER-CHIP in the early 90s) used a temporary variable for indexing, so when the instruction was finished, I would still hold the same value as it did before.
-*
-  * If you only pick one behavior, go with the modern one that doesn’t actually change the value of I. This will let you run the common CHIP-8 games you find everywhere, and it’s also what the common test ROMs depend on (the other behavior will fail the tests). But if you want your emulator to run older games from the 1970s or 1980s, you should consider making a configurable option in your emulator to toggle between these behaviors.
-*/
-  ST_MEM = 0xF055,
-  LD_MEM = 0xF065,
-  SENTINEL_OP = 0xFFFF,
-};
+//Self-modifying code: forget the decoded instruction at every address that overlaps the written bytes.
+//Breakpoints stay, they decode their instruction every time anyway.
+void InvalidateDecoded(Chip8Context& ctx, u16 address, u32 length){
+  for(u32 i = 0; i <= length; i++){
+    Operation& op = ctx.decoded[(u16)(address + i - 1)];
+    if(op != BREAKPOINT){
+      op = UNDECODED;
+    }
+  }
+}
 
-std::unordered_map<Operation, std::string> OperationToString = {
-  {CLS,"CLS"},
-  {RET,"RET"},
-  {JP,"JP"},
-  {CALL,"CALL"},
-  {SE_IMM,"SE_IMM"},
-  {SNE_IMM,"SNE_IMM"},
-  {SE_REG,"SE_REG"},
-  {SNE_REG,"SNE_REG"},
-  {LDX_IMM,"LDX_IMM"},
-  {LDX_REG,"LDX_REG"},
-  {ORX_REG,"ORX_REG"},
-  {ANDX_REG,"ANDX_REG"},
-  {XORX_REG,"XORX_REG"},
-  {ADDX_REG,"ADDX_REG"},
-  {SUB_REG,"SUB_REG"},
-  {SUBN_REG,"SUBN_REG"},
-  {SHR,"SHR"},
-  {SHL,"SHL"},
-  {ADDX_IMM,"ADDX_IMM"},
-  {SETI,"SETI"},
-  {JPOFFSET,"JPOFFSET"},
-  {RND,"RND"},
-  {SKP,"SKP"},
-  {SKNP,"SKNP"},
-  {DRAW,"DRAW"},
-  {LDX_TIMER,"LDX_TIMER"},
-  {LD_DT,"LD_DT"},
-  {LD_ST,"LD_ST"},
-  {ADDI_X,"ADDI_X"},
-  {LD_KEY,"LD_KEY"},
-  {LD_FONT,"LD_FONT"},
-  {BCD,"BCD"},
-  {ST_MEM,"ST_MEM"},
-  {LD_MEM,"LD_MEM"},
-  {SENTINEL_OP,"SENTINEL_OP"},
-};
-Operation GetOperation(u16 inst)
+//Draws an 8xN sprite, or a 16x16 one for DXY0 on SUPER-CHIP/XO-CHIP, into every selected plane.
+//XO-CHIP reads the sprite for the second plane right after the first one.
+//Each sprite row is XORed into at most two words of the packed display. Returns true if any pixel was erased.
+b8 DrawSprite(Chip8Context& ctx, u8 X, u8 Y, u8 N)
 {
-  u16 maskedInst = inst & OP_MASK;
-  Operation op = SENTINEL_OP;
-  switch(maskedInst){
-    case 0:
-      switch(inst){
-        case Operation::CLS:
-          op = Operation::CLS;
-          break;
-        case Operation::RET:
-          op = Operation::RET;
-          break;
-      }
-      break;
-    case 0xE000:
-      switch(inst & 0xE0FF){//Need to mask off X to get the opcode 
-        case Operation::SKP:
-          op = Operation::SKP;
-          break;
-        case Operation::SKNP:
-          op = Operation::SKNP;
-          break;
+  const u32 width = DisplayWidth(ctx);
+  const u32 height = DisplayHeight(ctx);
+  const u32 rowWords = width / 64;
+  const b8 wrap = ctx.platform->quirks.wrap;
+  const b8 large = N == 0 && ctx.platform->hires;
+  const u32 spriteWidth = large ? 16 : 8;
+  const u32 rows = large ? 16 : N;
+  const u32 x = ctx.registers[X] % width;
+  const u32 y = ctx.registers[Y] % height;
+  const u32 word = x / 64;
+  const u32 shift = x % 64;
+  u16 address = ctx.indexRegister;
+  b8 collision = false;
+  for(u32 plane = 0; plane < DISPLAY_PLANES; plane++){
+    if(!(ctx.planeMask & (1 << plane))){
+      continue;
+    }
+    for(u32 row = 0; row < rows; row++){
+      u64 bits = (u8)ctx.ram[address++];
+      if(large){
+        bits = (bits << 8) | (u8)ctx.ram[address++];
       }
-      break;
-    case 0xF000:
-      switch(inst & 0xF0FF){
-        case Operation::LDX_TIMER:
-          op = Operation::LDX_TIMER;
-          break;
-        case Operation::LD_DT:
-          op = Operation::LD_DT;
-          break;
-        case Operation::LD_ST:
-          op = Operation::LD_ST;
-          break;
-        case Operation::ADDI_X:
-          op = Operation::ADDI_X;
-          break;
-        case Operation::LD_KEY:
-          op = Operation::LD_KEY;
-          break;
-        case Operation::LD_FONT:
-          op = Operation::LD_FONT;
-          break;
-        case Operation::BCD:
-          op = Operation::BCD;
-          break;
-        case Operation::ST_MEM:
-          op = Operation::ST_MEM;
-          break;
-        case Operation::LD_MEM:
-          op = Operation::LD_MEM;
-          break;
+      u32 cellY = y + row;
+      if(cellY >= height){
+        if(!wrap){
+          continue;
+        }
+        cellY -= height;
       }
-      break;
-    case 0x8000:
-      switch(inst & 0x800f){
-        case Operation::LDX_REG:
-          op = Operation::LDX_REG;
-          break;
-        case Operation::ORX_REG:
-          op = Operation::ORX_REG;
-          break;
-        case Operation::ANDX_REG:
-          op = Operation::ANDX_REG;
-          break;
-        case Operation::XORX_REG:
-          op = Operation::XORX_REG;
-          break;
-        case Operation::ADDX_REG:
-          op = Operation::ADDX_REG;
-          break;
-        case Operation::SUB_REG:
-          op = Operation::SUB_REG;
-          break;
-        case Operation::SUBN_REG:
-          op = Operation::SUBN_REG;
-          break;
-        case Operation::SHR:
-          op = Operation::SHR;
-          break;
-        case Operation::SHL:
-          op = Operation::SHL;
-          break;
+      u64* line = ctx.display[plane][cellY];
+      bits <<= 64 - spriteWidth;//First pixel of the sprite in the most significant bit.
+      const u64 head = bits >> shift;
+      const u64 tail = shift ? bits << (64 - shift) : 0;//Part that spills into the next word.
+      collision |= (line[word] & head) != 0;
+      line[word] ^= head;
+      if(tail){
+        u32 nextWord = word + 1;
+        if(nextWord == rowWords){
+          if(!wrap){
+            continue;
+          }
+          nextWord = 0;
+        }
+        collision |= (line[nextWord] & tail) != 0;
+        line[nextWord] ^= tail;
       }
-      break;
-    case Operation::CALL:
-      op = Operation::CALL;
-      break;
-    case Operation::SE_IMM:
-      op = Operation::SE_IMM;
-      break;
-    case Operation::SNE_IMM:
-      op = Operation::SNE_IMM;
-      break;
-    case Operation::SE_REG:
-      op = Operation::SE_REG;
-      break;
-    case Operation::SNE_REG:
-      op = Operation::SNE_REG;
-      break;
-    case Operation::JP:
-      op = Operation::JP;
-      break;
-    case Operation::DRAW:
-      op = Operation::DRAW;
-      break;
-    case Operation::LDX_IMM:
-      op = Operation::LDX_IMM;
-      break;
-    case Operation::ADDX_IMM:
-      op = Operation::ADDX_IMM;
-      break;
-    case Operation::SETI:
-      op = Operation::SETI;
-      break;
-    case Operation::RND:
-      op = Operation::RND;
-      break;
-    case Operation::JPOFFSET:
-      op = Operation::JPOFFSET;
-      break;
-    default:
-      std::cout << "Could not preform instruction " << std::hex << inst << std::endl; 
-      break;
-  }
-  if(op == Operation::SENTINEL_OP){
-    std::cout << "Instruction not implemented: " << std::hex << inst << std::endl;
-  }
-  return op;
+    }
+  }
+  ctx.displayDirty = true;
+  return collision;
 }
-//Currently uses SDL's built-in integer scaling. Could implement it myself.
-//Also currently draws each point to the screen separately, should use a texture instead. 
-void DrawDisplay(SDL_Renderer* renderer, Chip8Context& ctx, u8 X, u8 Y, u8 N)
+//Scrolls the selected planes by whole rows, positive is down. Rows scrolled in are blank.
+void ScrollDisplayVertical(Chip8Context& ctx, i32 rows)
 {
-  ctx.VF = 0;//Set VF to 0, set to 1 if it causes any pixel to erase.
-  u8 x = ctx.registers[X] % CHIP8_DISPLAY_WIDTH;
-  u8 y = ctx.registers[Y] % CHIP8_DISPLAY_HEIGHT;
-  u8 countBytes = N;
-  for(u8 row = 0; row < countBytes; row++){
-    u8 pixelByte = ctx.ram[ctx.indexRegister+row];
-    for(u8 pixel = 0; pixel < 8; pixel++){
-      b8 color = pixelByte & (1 << pixel);
-      u8 cellX = x+7-pixel;//Draw from most significant bit to least significant bit
-      u8 cellY = y+row;
-      if(cellX < CHIP8_DISPLAY_WIDTH && cellY < CHIP8_DISPLAY_HEIGHT){
-        if(ctx.display[cellY][cellX] && color){//Set VF to 1 if turns off a pixel.
-          ctx.VF = 1;
-        }
-        ctx.display[cellY][cellX] ^= color;
-      }
+  const u32 height = DisplayHeight(ctx);
+  const u32 count = std::min((u32)std::abs(rows), height);
+  const size_t rowBytes = sizeof(ctx.display[0][0]);
+  for(u32 plane = 0; plane < DISPLAY_PLANES; plane++){
+    if(!(ctx.planeMask & (1 << plane))){
+      continue;
+    }
+    u64 (*lines)[DISPLAY_WORDS_PER_ROW] = ctx.display[plane];
+    if(rows > 0){
+      memmove(lines + count, lines, (height - count) * rowBytes);
+      memset(lines, 0, count * rowBytes);
+    }
+    else{
+      memmove(lines, lines + count, (height - count) * rowBytes);
+      memset(lines + height - count, 0, count * rowBytes);
     }
   }
-  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-  SDL_RenderClear(renderer);
-  //TODO: SLOW, Optimize to use a texture.
-  for(u32 row = 0; row < CHIP8_DISPLAY_HEIGHT; ++row){
-    for(u32 column = 0; column < CHIP8_DISPLAY_WIDTH; ++column){
-      if(ctx.display[row][column]){
-        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+  ctx.displayDirty = true;
+}
+//Scrolls the selected planes by less than a word worth of pixels, positive is right.
+void ScrollDisplayHorizontal(Chip8Context& ctx, i32 pixels)
+{
+  const u32 height = DisplayHeight(ctx);
+  const u32 count = std::abs(pixels);
+  assert(count > 0 && count < 64);
+  for(u32 plane = 0; plane < DISPLAY_PLANES; plane++){
+    if(!(ctx.planeMask & (1 << plane))){
+      continue;
+    }
+    for(u32 row = 0; row < height; row++){
+      u64* line = ctx.display[plane][row];
+      if(!ctx.hires){
+        line[0] = pixels > 0 ? line[0] >> count : line[0] << count;
+      }
+      else if(pixels > 0){
+        line[1] = (line[1] >> count) | (line[0] << (64 - count));
+        line[0] >>= count;
       }
       else{
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+        line[0] = (line[0] << count) | (line[1] >> (64 - count));
+        line[1] <<= count;
       }
-      SDL_RenderDrawPoint(renderer, column, row);
     }
   }
+  ctx.displayDirty = true;
+}
+//XO-CHIP's F000 NNNN is four bytes long, skips have to jump over all of it.
+inline void SkipInstruction(Chip8Context& ctx)
+{
+  const b8 longInstruction = ctx.platform->xo && (u8)ctx.ram[ctx.PC] == 0xF0 && (u8)ctx.ram[(u16)(ctx.PC + 1)] == 0x00;
+  ctx.PC += longInstruction ? 4 : 2;
+}
+
+//Uploads the scaled image into the streaming texture, which is window sized so SDL only has to copy it.
+void PresentDisplay(SDL_Renderer* renderer, SDL_Texture* texture, const Scaler& scaler)
+{
+  SDL_UpdateTexture(texture, nullptr, scaler.pixels.data(), scaler.width * sizeof(u32));
+  SDL_RenderClear(renderer);
+  SDL_RenderCopy(renderer, texture, nullptr, nullptr);
   SDL_RenderPresent(renderer);
 }
 
@@ -465,7 +266,15 @@ typedef struct {
     double phase;
     double freq;
     double volume;
+    //XO-CHIP audio pattern buffer, replaces the buzz once a ROM loads a pattern. Guarded by SDL_LockAudio.
+    b8 usePattern;
+    u8 pattern[16];
+    double patternRate;//1-bit samples per second
+    double patternPosition;
 } AudioData;
+inline double PitchToPatternRate(u8 pitch){
+  return 4000.0 * pow(2.0, (pitch - 64) / 48.0);
+}
 void audio_callback(void* userdata, Uint8* stream, int len) {
     AudioData* data = (AudioData*)userdata;
     float* buffer = (float*)stream;
@@ -476,6 +285,22 @@ void audio_callback(void* userdata, Uint8* stream, int len) {
     double volume = data->volume;
     double phase_increment = 2.0 * M_PI * freq / SAMPLE_RATE;
 
+    if (data->usePattern) {
+        constexpr double PATTERN_BITS = sizeof(data->pattern) * 8;
+        double position = data->patternPosition;
+        double position_increment = data->patternRate / SAMPLE_RATE;
+        for (int i = 0; i < samples; i++) {
+            u32 bit = (u32)position;
+            float value = ((data->pattern[bit >> 3] >> (7 - (bit & 7))) & 1 ? 1.0f : -1.0f) * volume;
+            buffer[i] = value;
+            position += position_increment;
+            if (position >= PATTERN_BITS)
+                position -= PATTERN_BITS;
+        }
+        data->patternPosition = position;
+        return;
+    }
+
     for (int i = 0; i < samples; i++) {
         // Square wave "buzz" tone
         float value = (sin(phase) > 0 ? 1.0f : -1.0f) * volume;
@@ -491,54 +316,339 @@ void audio_callback(void* userdata, Uint8* stream, int len) {
 
 
 
+//Picks how many instructions run per 60Hz frame. Runs the ROM's tickrate unless the host misses its frame
+//deadlines, then backs off and climbs back up once there is headroom again.
+//In turbo mode frames run back to back and only the latest one is presented at the host's frame rate.
+constexpr u32 MAX_TICK_RATE = 100000;
+struct FrameController{
+  u32 tickRate = 0;//Target instructions per frame.
+  u32 cyclesPerFrame = 0;//What actually runs, <= tickRate.
+  b8 turbo = false;
+  b8 vipTiming = false;//Frames are VIP_FRAME_MICROSECONDS of per-opcode time instead of tickRate instructions.
+  //Stats since the last report
+  u64 reportStart = 0;
+  u64 framesEmulated = 0;
+  u64 framesPresented = 0;
+  u64 framesSkipped = 0;
+  u64 deadlineMisses = 0;
+  u64 instructions = 0;
+};
+void SetTickRate(FrameController& controller, u32 tickRate){
+  controller.tickRate = std::clamp(tickRate, 1u, MAX_TICK_RATE);
+  controller.cyclesPerFrame = controller.tickRate;
+}
+//frameMs is the host time spent emulating and presenting one frame, budgetMs the length of a frame.
+void UpdateCyclesPerFrame(FrameController& controller, f64 frameMs, f64 budgetMs){
+  if(controller.turbo){
+    return;//Turbo runs as fast as it can anyway, there is no deadline to meet.
+  }
+  if(controller.vipTiming){
+    controller.deadlineMisses += frameMs > budgetMs;
+    return;//The frame length is the VIP's own timing, cyclesPerFrame isn't used.
+  }
+  if(frameMs > budgetMs){
+    controller.deadlineMisses++;
+    controller.cyclesPerFrame -= std::max(1u, controller.cyclesPerFrame / 8);
+    controller.cyclesPerFrame = std::max(1u, controller.cyclesPerFrame);
+  }
+  else if(frameMs < budgetMs / 2 && controller.cyclesPerFrame < controller.tickRate){
+    controller.cyclesPerFrame = std::min(controller.tickRate, controller.cyclesPerFrame + std::max(1u, controller.tickRate / 32));
+  }
+}
+//Prints achieved speed relative to tickRate * 60 instructions per second, at most once per second unless forced.
+void ReportFrameStats(FrameController& controller, u64 now, u64 counterFrequency, u32 frameRate, b8 force){
+  const f64 seconds = (now - controller.reportStart) / (f64)counterFrequency;
+  if(seconds < 1.0 && !force){
+    return;
+  }
+  if(seconds > 0.0){
+    const f64 instructionsPerSecond = controller.instructions / seconds;
+    const f64 framesPerSecond = controller.framesEmulated / seconds;
+    const f64 speed = controller.vipTiming ? framesPerSecond / frameRate : instructionsPerSecond / ((f64)controller.tickRate * frameRate);
+    std::cout << "speed " << std::fixed << std::setprecision(0) << 100.0 * speed << "%"
+      << " (" << instructionsPerSecond << " instructions/s, " << framesPerSecond << " frames/s)";
+    if(controller.vipTiming){
+      //Whatever fit in the frame's microseconds, cyclesPerFrame doesn't apply.
+      const u64 perFrame = controller.framesEmulated ? controller.instructions / controller.framesEmulated : 0;
+      std::cout << " cycles/frame " << perFrame << " vip timing";
+    }
+    else{
+      std::cout << " cycles/frame " << controller.cyclesPerFrame << "/" << controller.tickRate;
+    }
+    std::cout
+      << " presented " << controller.framesPresented
+      << " skipped " << controller.framesSkipped
+      << " deadline misses " << controller.deadlineMisses
+      << (controller.turbo ? " [turbo]" : "") << std::defaultfloat << std::endl;
+  }
+  controller.reportStart = now;
+  controller.framesEmulated = 0;
+  controller.framesPresented = 0;
+  controller.framesSkipped = 0;
+  controller.deadlineMisses = 0;
+  controller.instructions = 0;
+}
+
+//--build-pack takes rom[:platform[:tickrate]] so a mixed corpus can record what each ROM needs.
+//A suffix only counts if it names a platform, so paths with drive letters or colons still work.
+b8 ParsePackArgument(const char* arg, std::string* path, const PlatformProfile** platform, u32* tickRate){
+  *path = arg;
+  size_t colon = path->rfind(':');
+  if(colon == std::string::npos){
+    return true;
+  }
+  std::string last = path->substr(colon + 1);
+  if(!last.empty() && last.find_first_not_of("0123456789") == std::string::npos && colon > 0){
+    const size_t platformColon = path->rfind(':', colon - 1);
+    if(platformColon != std::string::npos && FindPlatform(path->substr(platformColon + 1, colon - platformColon - 1).c_str())){
+      const u32 romTickRate = (u32)strtoul(last.c_str(), nullptr, 10);
+      if(romTickRate == 0 || romTickRate > UINT16_MAX){
+        std::cerr << "Tickrate of " << arg << " must be between 1 and " << UINT16_MAX << std::endl;
+        return false;
+      }
+      *tickRate = romTickRate;
+      path->resize(colon);
+      colon = platformColon;
+      last = path->substr(colon + 1);
+    }
+  }
+  if(const PlatformProfile* romPlatform = FindPlatform(last.c_str())){
+    *platform = romPlatform;
+    path->resize(colon);
+  }
+  return true;
+}
+
 int main(int argc, char* argv[]) {
-  if(argc < 2){
+  const char* packPath = nullptr;
+  const char* buildPackPath = nullptr;
+  const char* capturePath = nullptr;
+  const char* codeMapPath = nullptr;
+  const char* screenshotPath = nullptr;
+  u32 scale = SCREEN_WIDTH / CHIP8_HIRES_DISPLAY_WIDTH;
+  u32 phosphor = 0;
+  u32 headlessFrames = 0;
+  b8 vipTiming = false;
+  u16 debugPort = 0;
+  const PlatformProfile* platform = nullptr;
+  u32 tickRate = 0;
+  b8 tickRateGiven = false;
+  b8 turbo = false;
+  std::vector<const char*> positional;
+  for(int i = 1; i < argc; i++){
+    if(strcmp(argv[i], "--platform") == 0 && i + 1 < argc){
+      platform = FindPlatform(argv[++i]);
+      if(!platform){
+        std::cerr << "Unknown platform " << argv[i] << ", expected one of:";
+        for(const PlatformProfile& p : PLATFORMS){
+          std::cerr << " " << p.id;
+        }
+        std::cerr << std::endl;
+        return 1;
+      }
+    }
+    else if(strcmp(argv[i], "--tickrate") == 0 && i + 1 < argc){
+      tickRate = (u32)strtoul(argv[++i], nullptr, 10);
+      tickRateGiven = true;
+    }
+    else if(strcmp(argv[i], "--turbo") == 0){
+      turbo = true;
+    }
+    else if(strcmp(argv[i], "--vip-timing") == 0){
+      vipTiming = true;
+    }
+    else if(strcmp(argv[i], "--capture") == 0 && i + 1 < argc){
+      capturePath = argv[++i];
+    }
+    else if(strcmp(argv[i], "--debug") == 0 && i + 1 < argc){
+      debugPort = (u16)strtoul(argv[++i], nullptr, 10);
+    }
+    else if(strcmp(argv[i], "--code-map") == 0 && i + 1 < argc){
+      codeMapPath = argv[++i];
+    }
+    else if(strcmp(argv[i], "--scale") == 0 && i + 1 < argc){
+      scale = (u32)strtoul(argv[++i], nullptr, 10);
+    }
+    else if(strcmp(argv[i], "--phosphor") == 0 && i + 1 < argc){
+      phosphor = (u32)strtoul(argv[++i], nullptr, 10);
+    }
+    else if(strcmp(argv[i], "--screenshot") == 0 && i + 1 < argc){
+      screenshotPath = argv[++i];
+    }
+    else if(strcmp(argv[i], "--headless") == 0 && i + 1 < argc){
+      headlessFrames = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+    }
+    else if(strcmp(argv[i], "--pack") == 0 && i + 1 < argc){
+      packPath = argv[++i];
+    }
+    else if(strcmp(argv[i], "--build-pack") == 0 && i + 1 < argc){
+      buildPackPath = argv[++i];
+    }
+    else{
+      positional.push_back(argv[i]);
+    }
+  }
+  if(positional.empty() && !packPath){
     std::cerr << "Need to supply CHIP8 emulator with a ROM." << std::endl;
+    std::cerr << "Usage: chip8 <rom> [--platform <id>] [--tickrate <instructions per frame>] [--vip-timing] [--turbo] [--capture <file>] [--debug <port>] [--code-map <file>]" << std::endl;
+    std::cerr << "                   [--scale <n>] [--phosphor <percent kept per frame>] [--screenshot <file.png>] [--headless <frames>]" << std::endl;
+    std::cerr << "       chip8 --pack <pack> [<rom hash>] [<options>]" << std::endl;
+    std::cerr << "       chip8 --build-pack <pack> [--platform <id>] [--tickrate <instructions per frame>] <rom>[:<platform>[:<tickrate>]]..." << std::endl;
     return 1;
   }
 
+  if(buildPackPath){
+    //Entries store the tickrate in 16 bits, same limits as a per-ROM suffix.
+    if(tickRateGiven && (tickRate == 0 || tickRate > UINT16_MAX)){
+      std::cerr << "Tickrate must be between 1 and " << UINT16_MAX << " for a ROM pack" << std::endl;
+      return 1;
+    }
+    std::vector<RomPackInput> inputs;
+    for(const char* arg : positional){
+      std::string path;
+      const PlatformProfile* romPlatform = platform;
+      u32 romTickRate = tickRate;
+      if(!ParsePackArgument(arg, &path, &romPlatform, &romTickRate)){
+        return 1;
+      }
+      std::error_code error;
+      const u64 size = std::filesystem::file_size(path, error);
+      if(error){
+        std::cerr << "Unable to open file " << path << std::endl;
+        return 1;
+      }
+      if(!romPlatform){
+        romPlatform = DefaultPlatformFor(size);
+      }
+      if(!romTickRate){
+        romTickRate = romPlatform->defaultTickrate;
+      }
+      inputs.push_back({path, (u8)(romPlatform - PLATFORMS), (u16)romTickRate});
+    }
+    return BuildRomPack(buildPackPath, inputs) ? 0 : 1;
+  }
+
+  //The ROM either comes from a file or straight out of a mapped pack, in both cases it is copied into ram once.
+  std::vector<char> buffer;
+  RomPack pack;
+  std::string romName;
+  const u8* romData = nullptr;
+  u64 romSize = 0;
+  if(packPath){
+    if(!OpenRomPack(&pack, packPath)){
+      return 1;
+    }
+    if(positional.empty()){
+      for(u32 i = 0; i < pack.header->entryCount; i++){
+        const RomPackEntry& entry = pack.entries[i];
+        const char* platformId = entry.platform < PLATFORM_COUNT ? PLATFORMS[entry.platform].id : "?";
+        std::cout << std::hex << std::setw(16) << std::setfill('0') << entry.hash << std::dec << std::setfill(' ')
+          << " " << std::setw(6) << entry.size << " " << std::setw(14) << platformId << " " << std::setw(5) << entry.tickrate
+          << " " << RomName(pack, entry) << std::endl;
+      }
+      return 0;
+    }
+    char* end = nullptr;
+    const u64 hash = strtoull(positional[0], &end, 16);
+    const RomPackEntry* entry = *end == '\0' ? FindRom(pack, hash) : nullptr;
+    if(!entry){
+      std::cerr << "No ROM with hash " << positional[0] << " in " << packPath << std::endl;
+      return 1;
+    }
+    //The stored tickrate was picked for the stored platform, another platform falls back to its own default.
+    if(!platform && entry->platform < PLATFORM_COUNT){
+      platform = &PLATFORMS[entry->platform];
+      if(!tickRate){
+        tickRate = entry->tickrate;
+      }
+    }
+    romName = RomName(pack, *entry);
+    romData = RomData(pack, *entry);
+    romSize = entry->size;
+  }
+  else{
+    buffer = LoadROM(positional[0]);
+    romName = positional[0];
+    romData = (const u8*)buffer.data();
+    romSize = buffer.size();
+  }
+  if(!platform){
+    platform = DefaultPlatformFor(romSize);
+  }
+  if(!tickRate){
+    tickRate = platform->defaultTickrate;
+  }
+  if(romSize > platform->memorySize - ROM_START){
+    std::cerr << "ROM " << romName << " is too big for platform " << platform->id << std::endl;
+    return 1;
+  }
   Chip8Context ctx = {0};
-  InitChip8Context(&ctx);
-  auto buffer = LoadROM(argv[1]);
-  for(unsigned char byte : buffer){
-    ctx.ram[ctx.PC++] = byte;
+  InitChip8Context(&ctx, platform);
+  memcpy(ctx.ram + ROM_START, romData, romSize);
+  if(codeMapPath){
+    //Made by chip8analyze, lets the ROM's code skip the decode on its first execution.
+    CodeMap codeMap;
+    if(!ReadCodeMap(&codeMap, codeMapPath)){
+      return 1;
+    }
+    if(codeMap.header.romSize != romSize || codeMap.header.romHash != HashRom(romData, romSize)){
+      std::cerr << "Code map " << codeMapPath << " was made for a different ROM" << std::endl;
+      return 1;
+    }
+    std::cout << "code map: " << PrewarmDecoded(ctx, codeMap) << " instructions pre-decoded" << std::endl;
   }
-  ctx.PC = 0x200;
+  CloseRomPack(&pack);
+
+  //Scaling happens on the CPU, see scaler.h. The window is exactly the size of the scaled image.
+  Scaler scaler;
+  InitScaler(&scaler, scale, phosphor);
+  const b8 headless = headlessFrames > 0;//No window or audio, runs that many frames as fast as it can.
 
-	if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+	if (SDL_Init(headless ? SDL_INIT_EVENTS : SDL_INIT_VIDEO) < 0) {
 		std::cerr << "SDL could not initialize! SDL_Error: " << SDL_GetError() << std::endl;
 		return 1;
 	} 
-	SDL_Window* window = SDL_CreateWindow(
-		(std::string("Chip8 ") + std::string(argv[1])).c_str(),
-		SDL_WINDOWPOS_CENTERED,
-		SDL_WINDOWPOS_CENTERED,
-		SCREEN_WIDTH,
-		SCREEN_HEIGHT,
-		SDL_WINDOW_SHOWN
-	);
-
-
-  if (!window) {
-    std::cerr << "Window could not be created! SDL_Error: " << SDL_GetError() << std::endl;
-    SDL_Quit();
-    return 1;
-  }
+  SDL_Window* window = nullptr;
+  SDL_Renderer* renderer = nullptr;
+  SDL_Texture* texture = nullptr;
+  if(!headless){
+		window = SDL_CreateWindow(
+			(std::string("Chip8 ") + romName).c_str(),
+			SDL_WINDOWPOS_CENTERED,
+			SDL_WINDOWPOS_CENTERED,
+			scaler.width,
+			scaler.height,
+			SDL_WINDOW_SHOWN
+		);
 
-	// Create renderer
-	SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-	if (!renderer) {
-		std::cerr << "Renderer could not be created! SDL_Error: " << SDL_GetError() << std::endl;
-		SDL_DestroyWindow(window);
-		SDL_Quit();
-		return 1;
-	}
-  //NOTE: Using SDL built-in integer scaling. If I want to, I could try to implement this myself.
-  SDL_RenderSetLogicalSize(renderer, CHIP8_DISPLAY_WIDTH, CHIP8_DISPLAY_HEIGHT);
-  SDL_RenderSetIntegerScale(renderer, SDL_TRUE);
+
+    if (!window) {
+      std::cerr << "Window could not be created! SDL_Error: " << SDL_GetError() << std::endl;
+      SDL_Quit();
+      return 1;
+    }
+
+		// Create renderer
+		renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+		if (!renderer) {
+			std::cerr << "Renderer could not be created! SDL_Error: " << SDL_GetError() << std::endl;
+			SDL_DestroyWindow(window);
+			SDL_Quit();
+			return 1;
+		}
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+        scaler.width, scaler.height);
+    if (!texture) {
+      std::cerr << "Texture could not be created! SDL_Error: " << SDL_GetError() << std::endl;
+      SDL_DestroyRenderer(renderer);
+      SDL_DestroyWindow(window);
+      SDL_Quit();
+      return 1;
+    }
+  }
 
 	//Audio
-	AudioData data = {0, 22.0, 0.2}; 
+	AudioData data = {0, 22.0, 0.2, false, {0}, PitchToPatternRate(64), 0.0}; 
 	SDL_AudioSpec want, have;
 	SDL_zero(want);
 	want.freq = SAMPLE_RATE;
@@ -547,7 +657,7 @@ int main(int argc, char* argv[]) {
   want.samples = 512;
   want.callback = audio_callback;
   want.userdata = &data;
-  if(SDL_OpenAudio(&want, &have) < 0){
+  if(!headless && SDL_OpenAudio(&want, &have) < 0){
     std::cerr << "Failed to open audio " << SDL_GetError() << std::endl;
     SDL_Quit();
     return 1;
@@ -567,7 +677,6 @@ int main(int argc, char* argv[]) {
   SDL_Event e;
 
 	
-  u32 cycle = 1;
   b8 emulate = true;
   std::unordered_map<SDL_Scancode, u8> buttonMap = {
     {SDL_SCANCODE_1, 0x1},{SDL_SCANCODE_2, 0x2},{SDL_SCANCODE_3, 0x3},{SDL_SCANCODE_4, 0xC},
@@ -580,8 +689,41 @@ int main(int argc, char* argv[]) {
   f64 lastTimerTick = 0.0;
   constexpr u32 FRAME_RATE = 60;//60Hz refresh rate
   constexpr f64 msPerTimerTick = (1.0/FRAME_RATE) * 1000.0;
-  constexpr u32 TICK_RATE = 30;//NOTE: games and different implemenations might have a different tick rate. Tick rate results in TICK_RATE * FRAME_RATE for instructions per second. https://github.com/chip-8/chip-8-database 
-  u64 instructionsPerFrame = 0;
+  //NOTE: games and different implemenations might have a different tick rate. Tick rate results in tickRate * FRAME_RATE for instructions per second. https://github.com/chip-8/chip-8-database 
+  constexpr f64 MAX_LAG_MS = 4 * msPerTimerTick;//Past this we stop trying to catch up and drop the backlog.
+  FrameController frameController;
+  SetTickRate(frameController, tickRate);
+  frameController.turbo = turbo || headless;
+  frameController.vipTiming = vipTiming;
+  frameController.reportStart = lastFrame;
+  u64 lastPresent = lastFrame;
+  b8 presentPending = false;//The scaled image changed but turbo hasn't presented it yet.
+  u32 frameNumber = 0;
+  //Recording of every presented frame, encoded on a background thread. See capture.h.
+  Capture* capture = nullptr;
+  if(capturePath){
+    capture = new Capture;
+    if(!StartCapture(capture, capturePath, FRAME_RATE, headless)){
+      delete capture;
+      SDL_Quit();
+      return 1;
+    }
+  }
+  //Debugger on a loopback port, see debugger.h. Without it ctx.debugger stays null and nothing is checked.
+  Debugger* debugger = nullptr;
+  if(debugPort){
+    debugger = new Debugger;
+    if(!StartDebugger(debugger, debugPort)){
+      delete debugger;
+      if(capture){
+        StopCapture(capture, frameNumber);
+        delete capture;
+      }
+      SDL_Quit();
+      return 1;
+    }
+    ctx.debugger = debugger;
+  }
 	// Main loop
 	while (!quit) {
     //Timer ticks
@@ -590,19 +732,31 @@ int main(int argc, char* argv[]) {
     f64 dt = ((currentFrame - lastFrame) / (f64)counterFrequency) * 1000;//in ms
     lastTimerTick += dt;
     lastFrame = currentFrame;
-    if(lastTimerTick >= msPerTimerTick){
-      if(ctx.delayTimer > 0){
+    if(lastTimerTick > MAX_LAG_MS){
+      frameController.deadlineMisses++;
+      lastTimerTick = 0.0;
+    }
+    if(frameController.turbo || lastTimerTick >= msPerTimerTick){
+      const b8 paused = debugger && debugger->paused;//Time stands still while the debugger has us stopped.
+      if(ctx.delayTimer > 0 && !paused){
         ctx.delayTimer -= 1;
       }
-      if(ctx.soundTimer > 0){
+      if(ctx.soundTimer > 0 && !paused){
         ctx.soundTimer -= 1;
         if(ctx.soundTimer == 0){
           SDL_PauseAudio(1);
         }
       }
-      lastTimerTick -= msPerTimerTick;
+      lastTimerTick = frameController.turbo ? 0.0 : lastTimerTick - msPerTimerTick;
       emulate = true;
     }
+    else{
+      //Nothing to do until the next tick, sleep instead of spinning. SDL_Delay can oversleep by about a millisecond.
+      const f64 idleMs = msPerTimerTick - lastTimerTick - 1.0;
+      if(idleMs >= 1.0){
+        SDL_Delay((u32)idleMs);
+      }
+    }
 
     if(emulate){
       u64 emulationStart = SDL_GetPerformanceCounter();
@@ -611,6 +765,29 @@ int main(int argc, char* argv[]) {
         if (e.type == SDL_QUIT)
           quit = true;
         //TODO: Currently it seems input is being dropped, probably because the emulation and the input logic is mismatched (someone can <down><up> a key and the emulator wouldn't recognize it because we only see press down
+        if(e.type == SDL_KEYDOWN && !e.key.repeat){
+          switch(e.key.keysym.scancode){
+            case SDL_SCANCODE_TAB:
+              frameController.turbo = !frameController.turbo;
+              std::cout << "turbo " << (frameController.turbo ? "on" : "off") << std::endl;
+              break;
+            case SDL_SCANCODE_F12:
+              {
+                const std::string path = "chip8-" + std::to_string(frameNumber) + ".png";
+                if(WritePng(path.c_str(), scaler.pixels.data(), scaler.width, scaler.height)){
+                  std::cout << "screenshot " << path << std::endl;
+                }
+              }
+              break;
+            case SDL_SCANCODE_PAGEUP:
+            case SDL_SCANCODE_PAGEDOWN:
+              SetTickRate(frameController, e.key.keysym.scancode == SDL_SCANCODE_PAGEUP ? frameController.tickRate * 2 : frameController.tickRate / 2);
+              std::cout << "tickrate " << frameController.tickRate << std::endl;
+              break;
+            default:
+              break;
+          }
+        }
         if(e.type == SDL_KEYDOWN){
           if(auto it = buttonMap.find(e.key.keysym.scancode); it != buttonMap.end()){
             std::cout << "chip8 key " << SDL_GetKeyName(SDL_GetKeyFromScancode(e.key.keysym.scancode)) << " pressed" << std::endl;
@@ -627,7 +804,16 @@ int main(int argc, char* argv[]) {
           }
         }
       }
-      while(ctx.instructionsPerformed < TICK_RATE){
+      //With VIP timing the frame ends once its microseconds are used up, the instruction count only caps it.
+      u32 budget = frameController.vipTiming ? MAX_TICK_RATE : frameController.cyclesPerFrame;
+      const u32 cycleBudget = frameController.vipTiming ? VIP_FRAME_MICROSECONDS : UINT32_MAX;
+      b8 vblankStall = false;//A DRAW ended the frame without running.
+      if(debugger){
+        PollDebugger(debugger, ctx);
+        budget = DebuggerBudget(debugger, budget);
+      }
+      while(ctx.instructionsPerformed < budget && ctx.cycles < cycleBudget){
+        const u16 address = ctx.PC;
         u8 byte1 = ctx.ram[ctx.PC++];
         u8 byte2 = ctx.ram[ctx.PC++];
         u16 inst = (((u16)byte1) << 8) | ((u16)byte2);
@@ -638,29 +824,64 @@ int main(int argc, char* argv[]) {
         u8 NN = (u8)MASK_NN(inst);
         u16 NNN = (u16)MASK_NNN(inst);
 
-        Operation op = GetOperation(inst);
+        Operation op = ctx.decoded[address];
+        if(op == UNDECODED){
+          op = GetOperation(inst, ctx.platform);
+          ctx.decoded[address] = op;
+          if(op == SENTINEL_OP){
+            std::cout << "Instruction not implemented: " << std::hex << inst << std::dec << std::endl;
+          }
+        }
         assert(op != SENTINEL_OP);
-        // std::cout << "Preforming operation #" << cycle++ << ":"<< OperationToString.at(op) << std::endl;
-        // std::cout << "X: " << +X << " Y: " << +Y << " N: " << +N << " NN: " << +NN << " NNN: " << +NNN << std::endl;
+        dispatch:
         switch(op){
+          case Operation::BREAKPOINT:
+            //Only addresses with a breakpoint get here, everything else dispatches straight from the cache.
+            if(ctx.debugger->resumeFrom != address){
+              ctx.PC = address;
+              ctx.debugger->stopReason = "breakpoint";
+              ctx.stop = true;
+              break;
+            }
+            ctx.debugger->resumeFrom = -1;
+            op = GetOperation(inst, ctx.platform);
+            goto dispatch;
           case Operation::CLS:
-            // Clear screen with black
-            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-            SDL_RenderClear(renderer);
-            SDL_RenderPresent(renderer);
             ClearDisplay(&ctx);
             break;
           case Operation::RET:
             ctx.PC = ctx.stack.Pop();
             break;
+          case Operation::SCD:
+            ScrollDisplayVertical(ctx, N);
+            break;
+          case Operation::SCU:
+            ScrollDisplayVertical(ctx, -N);
+            break;
+          case Operation::SCR:
+            ScrollDisplayHorizontal(ctx, 4);
+            break;
+          case Operation::SCL:
+            ScrollDisplayHorizontal(ctx, -4);
+            break;
+          case Operation::EXIT:
+            ctx.exit = true;
+            ctx.stop = true;
+            break;
+          case Operation::LOW:
+            SetHires(&ctx, false);
+            break;
+          case Operation::HIGH:
+            SetHires(&ctx, true);
+            break;
           case Operation::SKP:
             if(ctx.registers[X] <= 0xF && ctx.buttons[ctx.registers[X]]){
-              ctx.PC += 2;
+              SkipInstruction(ctx);
             }
             break;
           case Operation::SKNP:
             if(ctx.registers[X] <= 0xF && !ctx.buttons[ctx.registers[X]]){
-              ctx.PC += 2;
+              SkipInstruction(ctx);
             }
             break;
           case Operation::LDX_TIMER:
@@ -699,55 +920,149 @@ int main(int argc, char* argv[]) {
           case Operation::LD_FONT:
             ctx.indexRegister = (ctx.registers[X] & 0xF)*BYTES_PER_FONT;
             break;
+          case Operation::LD_HFONT:
+            ctx.indexRegister = BIG_FONT_OFFSET + (ctx.registers[X] & 0xF)*BYTES_PER_BIG_FONT;
+            break;
           case Operation::BCD:
             {
               u8 b = ctx.registers[X];
               i8 i = 2;
               while(i >= 0){
-                ctx.ram[ctx.indexRegister + i--] = b%10;
+                ctx.ram[(u16)(ctx.indexRegister + i--)] = b%10;
                 b /= 10;
               }
+              InvalidateDecoded(ctx, ctx.indexRegister, 3);
+              if(ctx.watching){
+                CheckWatchpoints(ctx, ctx.indexRegister, 3, WATCH_WRITE);
+              }
             }
             break;
+          //NOTE: memory instructions are ambiguous, see enum definition.
           case Operation::ST_MEM:
             for(u8 i = 0; i <= X; i++){
-              ctx.ram[ctx.indexRegister + i] = ctx.registers[i];
+              ctx.ram[(u16)(ctx.indexRegister + i)] = ctx.registers[i];
+            }
+            InvalidateDecoded(ctx, ctx.indexRegister, X + 1);
+            if(ctx.watching){
+              CheckWatchpoints(ctx, ctx.indexRegister, X + 1, WATCH_WRITE);
+            }
+            if(!ctx.platform->quirks.memoryLeaveIUnchanged){
+              ctx.indexRegister += ctx.platform->quirks.memoryIncrementByX ? X : X + 1;
             }
             break;
           case Operation::LD_MEM:
             for(u8 i = 0; i <= X; i++){
-              ctx.registers[i] = ctx.ram[ctx.indexRegister + i];
+              ctx.registers[i] = ctx.ram[(u16)(ctx.indexRegister + i)];
+            }
+            if(ctx.watching){
+              CheckWatchpoints(ctx, ctx.indexRegister, X + 1, WATCH_READ);
+            }
+            if(!ctx.platform->quirks.memoryLeaveIUnchanged){
+              ctx.indexRegister += ctx.platform->quirks.memoryIncrementByX ? X : X + 1;
+            }
+            break;
+          case Operation::ST_RANGE:
+          case Operation::LD_RANGE:
+            {
+              const u8 count = (X <= Y ? Y - X : X - Y) + 1;
+              for(u8 i = 0; i < count; i++){
+                const u8 reg = X <= Y ? X + i : X - i;
+                const u16 at = (u16)(ctx.indexRegister + i);
+                if(op == Operation::ST_RANGE){
+                  ctx.ram[at] = ctx.registers[reg];
+                }
+                else{
+                  ctx.registers[reg] = ctx.ram[at];
+                }
+              }
+              if(op == Operation::ST_RANGE){
+                InvalidateDecoded(ctx, ctx.indexRegister, count);
+              }
+              if(ctx.watching){
+                CheckWatchpoints(ctx, ctx.indexRegister, count, op == Operation::ST_RANGE ? WATCH_WRITE : WATCH_READ);
+              }
+            }
+            break;
+          case Operation::ST_FLAGS:
+            for(u8 i = 0; i <= X; i++){
+              ctx.flags[i] = ctx.registers[i];
+            }
+            break;
+          case Operation::LD_FLAGS:
+            for(u8 i = 0; i <= X; i++){
+              ctx.registers[i] = ctx.flags[i];
             }
             break;
+          case Operation::LONG_I:
+            ctx.indexRegister = (((u16)(u8)ctx.ram[ctx.PC]) << 8) | (u16)(u8)ctx.ram[(u16)(ctx.PC + 1)];
+            ctx.PC += 2;
+            break;
+          case Operation::PLANE:
+            ctx.planeMask = X & 0x3;
+            break;
+          case Operation::AUDIO:
+            for(u8 i = 0; i < sizeof(ctx.audioPattern); i++){
+              ctx.audioPattern[i] = ctx.ram[(u16)(ctx.indexRegister + i)];
+            }
+            if(ctx.watching){
+              CheckWatchpoints(ctx, ctx.indexRegister, sizeof(ctx.audioPattern), WATCH_READ);
+            }
+            SDL_LockAudio();
+            memcpy(data.pattern, ctx.audioPattern, sizeof(data.pattern));
+            data.usePattern = true;
+            SDL_UnlockAudio();
+            break;
+          case Operation::PITCH:
+            ctx.pitch = ctx.registers[X];
+            SDL_LockAudio();
+            data.patternRate = PitchToPatternRate(ctx.pitch);
+            SDL_UnlockAudio();
+            break;
           case Operation::CALL:
             ctx.stack.Push(ctx.PC);
             ctx.PC = NNN;
             break;
           case Operation::SE_IMM:
             if(ctx.registers[X] == NN){
-              ctx.PC += 2;
+              SkipInstruction(ctx);
             }
             break;
           case Operation::SNE_IMM:
             if(ctx.registers[X] != NN){
-              ctx.PC += 2;
+              SkipInstruction(ctx);
             }
             break;
           case Operation::SE_REG:
             if(ctx.registers[X] == ctx.registers[Y]){
-              ctx.PC += 2;
+              SkipInstruction(ctx);
             }
             break;
           case Operation::SNE_REG:
             if(ctx.registers[X] != ctx.registers[Y]){
-              ctx.PC += 2;
+              SkipInstruction(ctx);
             }
             break;
           case Operation::JP:
             ctx.PC = NNN;
             break;
           case Operation::DRAW:
-            DrawDisplay(renderer, ctx, X, Y, N);
+            if(ctx.platform->quirks.vblank && !ctx.vblankWait){
+              //The VIP interpreter waits for the display interrupt before drawing. Rather than spinning on it the
+              //rest of the frame is skipped, the DRAW runs again as the first instruction of the next one.
+              ctx.PC = address;
+              ctx.vblankWait = true;
+              vblankStall = true;
+              if(ctx.decoded[address] == BREAKPOINT){
+                ctx.debugger->resumeFrom = address;//Already stopped here once, running it next frame must not stop again.
+              }
+              break;
+            }
+            ctx.vblankWait = false;
+            ctx.VF = DrawSprite(ctx, X, Y, N) ? 1 : 0;//Set VF to 1 if it causes any pixel to erase.
+            if(ctx.watching){
+              const u32 planes = (ctx.planeMask & 1) + (ctx.planeMask >> 1);
+              CheckWatchpoints(ctx, ctx.indexRegister, (N == 0 && ctx.platform->hires ? 32 : N) * planes, WATCH_READ);
+            }
             break;
           //---- 0x8000 instructions, need to mask last nibble aswell
           case Operation::LDX_REG:
@@ -756,15 +1071,21 @@ int main(int argc, char* argv[]) {
           //NOTE: the and, or and xor instructions set VF to 0.
           case Operation::ORX_REG:
             ctx.registers[X] |= ctx.registers[Y];
-            // ctx.VF = 0;
+            if(ctx.platform->quirks.logic){
+              ctx.VF = 0;
+            }
             break;
           case Operation::ANDX_REG:
             ctx.registers[X] &= ctx.registers[Y];
-            // ctx.VF = 0;
+            if(ctx.platform->quirks.logic){
+              ctx.VF = 0;
+            }
             break;
           case Operation::XORX_REG:
             ctx.registers[X] ^= ctx.registers[Y];
-            // ctx.VF = 0;
+            if(ctx.platform->quirks.logic){
+              ctx.VF = 0;
+            }
             break;
           case Operation::ADDX_REG:
             {
@@ -788,6 +1109,9 @@ int main(int argc, char* argv[]) {
           //NOTE shifting are ambiguous instructions, might want to have configurable behaviour, see enum defintion.
           case Operation::SHR:
             {
+              if(!ctx.platform->quirks.shift){
+                ctx.registers[X] = ctx.registers[Y];
+              }
               u8 borrow = (ctx.registers[X] & 0x1) ? 1 : 0;
               u8 result = ctx.registers[X] >> 1;
               ctx.registers[X] = result;
@@ -796,6 +1120,9 @@ int main(int argc, char* argv[]) {
             break;
           case Operation::SHL:
             {
+              if(!ctx.platform->quirks.shift){
+                ctx.registers[X] = ctx.registers[Y];
+              }
               u8 borrow = (ctx.registers[X] & 0x80) ? 1 : 0;
               u8 result = ctx.registers[X] << 1;
               ctx.registers[X] = result;
@@ -812,7 +1139,7 @@ int main(int argc, char* argv[]) {
             ctx.indexRegister = NNN;
             break;
           case Operation::JPOFFSET:
-            ctx.PC = NNN + ctx.V0;
+            ctx.PC = NNN + (ctx.platform->quirks.jump ? ctx.registers[X] : ctx.V0);
             break;
           case Operation::RND:
             {
@@ -824,22 +1151,88 @@ int main(int argc, char* argv[]) {
             std::cout << "Could not preform instruction " << std::hex << inst << std::endl; 
             break;
         }
+        if(vblankStall){
+          break;//Not counted or charged, the DRAW runs and pays for itself next frame.
+        }
+        if(op == Operation::BREAKPOINT){
+          break;//Stopped before the instruction ran, it's counted once resumed. A resume dispatches the real operation.
+        }
         ctx.instructionsPerformed++;
-        instructionsPerFrame++;
+        if(frameController.vipTiming){
+          ctx.cycles += VipInstructionTime(inst);
+        }
+        if(ctx.stop){
+          quit = ctx.exit;
+          break;
+        }
+      }
+      if(vblankStall){
+        ctx.cycles = 0;//The next frame starts at the interrupt the DRAW waited for.
+      }
+      else{
+        //Time an instruction ran past the end of the frame comes out of the next one.
+        ctx.cycles = ctx.cycles > cycleBudget ? ctx.cycles - cycleBudget : 0;
+      }
+      if(debugger && !ctx.exit){
+        DebuggerFrameEnd(debugger, ctx);
+      }
+      frameController.framesEmulated++;
+      frameNumber++;
+      frameController.instructions += ctx.instructionsPerformed;
+      //Phosphor persistence keeps changing the image for a few frames after the display itself stopped.
+      if((ctx.displayDirty || scaler.fading) && UpdateScaler(&scaler, ctx.display, ctx.hires)){
+        if(presentPending){
+          frameController.framesSkipped++;//Replaced before it was ever shown.
+        }
+        presentPending = true;
+      }
+      ctx.displayDirty = false;
+      //Turbo only presents at the host's frame rate, the frames in between are never seen. The latest image stays
+      //pending until then, even if the display stops changing in the meantime.
+      if(presentPending){
+        u64 presentTime = SDL_GetPerformanceCounter();
+        if(headless || !frameController.turbo || ((presentTime - lastPresent) / (f64)counterFrequency) * 1000 >= msPerTimerTick){
+          if(!headless){
+            PresentDisplay(renderer, texture, scaler);
+          }
+          if(capture){
+            CaptureFrame(capture, frameNumber, ctx.display, ctx.hires);
+          }
+          frameController.framesPresented++;
+          lastPresent = presentTime;
+          presentPending = false;
+        }
+      }
+      if(headless && frameNumber >= headlessFrames){
+        quit = true;
       }
       u64 emulationFinish = SDL_GetPerformanceCounter();
-      std::cout << "Total emulation time (in ms): " << ((emulationFinish-emulationStart) / (f64)counterFrequency) * 1000 << std::endl;
-    // f64 dt = ((currentFrame - lastFrame) / (f64)counterFrequency) * 1000;//in ms
+      UpdateCyclesPerFrame(frameController, ((emulationFinish-emulationStart) / (f64)counterFrequency) * 1000, msPerTimerTick);
+      ReportFrameStats(frameController, emulationFinish, counterFrequency, FRAME_RATE, false);
       emulate = false;
       ctx.instructionsPerformed = 0;
     }
 	}
 
+	ReportFrameStats(frameController, SDL_GetPerformanceCounter(), counterFrequency, FRAME_RATE, true);
+  //A failed screenshot still lets the capture and debugger shut down, it only changes the exit code.
+  const b8 screenshotWritten = !screenshotPath || WritePng(screenshotPath, scaler.pixels.data(), scaler.width, scaler.height);
+  b8 captured = true;
+  if(capture){
+    captured = StopCapture(capture, frameNumber);
+    delete capture;
+  }
+  if(debugger){
+    StopDebugger(debugger);
+    delete debugger;
+  }
+
 	// Clean up
+	SDL_DestroyTexture(texture);
 	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
 	SDL_Quit();
 
-	return 0;
+	return captured && screenshotWritten ? 0 : 1;
 }
 
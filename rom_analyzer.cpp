@@ -0,0 +1,453 @@
+//chip8analyze: recursive disassembler that finds the code of a ROM and writes its control-flow graph
+//as DOT and JSON, plus a code/data map chip8 --code-map uses to pre-decode the ROM.
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "chip8.h"
+#include "rompack.h"
+#include "codemap.h"
+
+enum EdgeKind : u8 {
+  EDGE_FALLTHROUGH,
+  EDGE_JUMP,
+  EDGE_SKIP,//Taken when a skip instruction skips.
+  EDGE_CALL,
+};
+constexpr const char* EDGE_NAMES[] = {"fallthrough", "jump", "skip", "call"};
+
+struct Edge{
+  u16 target;
+  EdgeKind kind;
+};
+
+struct BasicBlock{
+  u16 start;
+  u16 end;//Address after the last instruction.
+  std::vector<Edge> edges;
+};
+
+//A store through I. target is -1 when I isn't known at that point.
+struct Store{
+  u16 address;
+  i32 target;
+  u32 length;
+  b8 intoCode;
+};
+
+struct RomAnalysis{
+  std::string name;
+  const PlatformProfile* platform;
+  const u8* rom;
+  u32 romSize;
+  CodeMap map;
+  std::vector<u8> leaders;//Bitmap like the code map, addresses that start a basic block.
+  std::vector<BasicBlock> blocks;
+  std::vector<u16> computedJumps;
+  std::vector<u16> invalid;//Reachable words that don't decode to an instruction.
+  std::vector<Store> stores;
+};
+
+static b8 InRom(const RomAnalysis& analysis, u32 address, u32 length){
+  return address >= ROM_START && address + length <= ROM_START + analysis.romSize;
+}
+
+static u16 ReadWord(const RomAnalysis& analysis, u32 address){
+  const u32 offset = address - ROM_START;
+  return ((u16)analysis.rom[offset] << 8) | analysis.rom[offset + 1];
+}
+
+static u32 InstructionLength(Operation op){
+  return op == LONG_I ? 4 : 2;
+}
+
+static b8 IsSkip(Operation op){
+  return op == SE_IMM || op == SNE_IMM || op == SE_REG || op == SNE_REG || op == SKP || op == SKNP;
+}
+
+//Same rule as SkipInstruction: XO-CHIP skips both words of F000 NNNN.
+static u16 SkipTarget(const RomAnalysis& analysis, u16 address){
+  const u16 next = address + 2;
+  const b8 longInstruction = analysis.platform->xo && InRom(analysis, next, 2) && ReadWord(analysis, next) == 0xF000;
+  return next + (longInstruction ? 4 : 2);
+}
+
+static void MarkLeader(RomAnalysis& analysis, u16 address, std::vector<u16>& worklist){
+  if(InRom(analysis, address, 1) && !TestBit(analysis.leaders, address - ROM_START)){
+    SetBit(analysis.leaders, address - ROM_START);
+    worklist.push_back(address);
+  }
+}
+
+//Pass 1: follow every path from ROM_START and mark the instructions and block leaders it finds.
+static void FindCode(RomAnalysis& analysis){
+  std::vector<u16> worklist;
+  MarkLeader(analysis, ROM_START, worklist);
+  while(!worklist.empty()){
+    u16 address = worklist.back();
+    worklist.pop_back();
+    while(InRom(analysis, address, 2)){
+      const u32 offset = address - ROM_START;
+      if(TestBit(analysis.map.starts, offset)){
+        //Another path already went this way, it just has to start a block of its own now.
+        SetBit(analysis.leaders, offset);
+        break;
+      }
+      const u16 inst = ReadWord(analysis, address);
+      const Operation op = GetOperation(inst, analysis.platform);
+      const u32 length = InstructionLength(op);
+      if(op == SENTINEL_OP || !InRom(analysis, address, length)){
+        analysis.invalid.push_back(address);
+        break;
+      }
+      SetBit(analysis.map.starts, offset);
+      for(u32 i = 0; i < length; i++){
+        SetBit(analysis.map.code, offset + i);
+      }
+      const u16 next = address + length;
+      if(op == JP){
+        MarkLeader(analysis, MASK_NNN(inst), worklist);
+        break;
+      }
+      if(op == RET || op == EXIT){
+        break;
+      }
+      if(op == JPOFFSET){
+        analysis.computedJumps.push_back(address);
+        break;
+      }
+      if(op == CALL){
+        MarkLeader(analysis, MASK_NNN(inst), worklist);
+        MarkLeader(analysis, next, worklist);
+        break;
+      }
+      if(IsSkip(op)){
+        MarkLeader(analysis, SkipTarget(analysis, address), worklist);
+        MarkLeader(analysis, next, worklist);
+        break;
+      }
+      address = next;
+    }
+  }
+}
+
+//Pass 2: cut the code into basic blocks at the leaders, and work out where stores through I land.
+static void BuildBlocks(RomAnalysis& analysis){
+  const Quirks& quirks = analysis.platform->quirks;
+  for(u32 offset = 0; offset < analysis.romSize; offset++){
+    if(!TestBit(analysis.leaders, offset) || !TestBit(analysis.map.starts, offset)){
+      continue;
+    }
+    BasicBlock block = {};
+    block.start = (u16)(ROM_START + offset);
+    u16 address = block.start;
+    i32 indexRegister = -1;//Constant value of I within the block, -1 once it depends on registers.
+    b8 fallsThrough = true;
+    while(true){
+      const u16 inst = ReadWord(analysis, address);
+      const Operation op = GetOperation(inst, analysis.platform);
+      const u16 next = address + InstructionLength(op);
+      const u8 X = (u8)MASK_X(inst);
+      const u8 Y = (u8)MASK_Y(inst);
+      if(op == BCD || op == ST_MEM || op == ST_RANGE){
+        Store store = {address, indexRegister, 0, false};
+        store.length = op == BCD ? 3 : op == ST_MEM ? X + 1u : (X <= Y ? Y - X : X - Y) + 1u;
+        for(u32 i = 0; indexRegister >= 0 && i < store.length; i++){
+          const u32 target = (u16)(indexRegister + i);
+          store.intoCode |= InRom(analysis, target, 1) && TestBit(analysis.map.code, target - ROM_START);
+        }
+        analysis.stores.push_back(store);
+      }
+      switch(op){
+        case SETI:
+          indexRegister = MASK_NNN(inst);
+          break;
+        case LONG_I:
+          indexRegister = ReadWord(analysis, address + 2);
+          break;
+        case ST_MEM:
+        case LD_MEM:
+          if(indexRegister >= 0 && !quirks.memoryLeaveIUnchanged){
+            indexRegister = (u16)(indexRegister + (quirks.memoryIncrementByX ? X : X + 1));
+          }
+          break;
+        case ADDI_X:
+        case LD_FONT:
+        case LD_HFONT:
+          indexRegister = -1;
+          break;
+        default:
+          break;
+      }
+      if(op == JP){
+        block.edges.push_back({MASK_NNN(inst), EDGE_JUMP});
+        fallsThrough = false;
+      }
+      else if(op == CALL){
+        block.edges.push_back({MASK_NNN(inst), EDGE_CALL});
+      }
+      else if(IsSkip(op)){
+        block.edges.push_back({SkipTarget(analysis, address), EDGE_SKIP});
+      }
+      else if(op == RET || op == EXIT || op == JPOFFSET){
+        fallsThrough = false;
+      }
+      address = next;
+      const b8 endsBlock = op == JP || op == CALL || IsSkip(op) || !fallsThrough;
+      if(endsBlock || !InRom(analysis, address, 2) || !TestBit(analysis.map.starts, address - ROM_START)
+          || TestBit(analysis.leaders, address - ROM_START)){
+        break;
+      }
+    }
+    block.end = address;
+    if(fallsThrough){
+      block.edges.insert(block.edges.begin(), {address, EDGE_FALLTHROUGH});
+    }
+    analysis.blocks.push_back(std::move(block));
+  }
+  for(const Store& store : analysis.stores){
+    if(store.intoCode){
+      analysis.map.header.flags |= CODE_MAP_SELF_MODIFYING;
+    }
+  }
+  if(!analysis.computedJumps.empty()){
+    analysis.map.header.flags |= CODE_MAP_COMPUTED_JUMPS;
+  }
+}
+
+static std::string Hex(u32 value){
+  std::ostringstream out;
+  out << "0x" << std::hex << std::uppercase << std::setw(4) << std::setfill('0') << value;
+  return out.str();
+}
+
+static std::string Disassemble(const RomAnalysis& analysis, u16 address, u16* next){
+  const u16 inst = ReadWord(analysis, address);
+  const Operation op = GetOperation(inst, analysis.platform);
+  std::ostringstream out;
+  out << std::hex << std::uppercase << std::setfill('0') << std::setw(4) << inst;
+  if(op == LONG_I){
+    out << " " << std::setw(4) << ReadWord(analysis, address + 2);
+  }
+  out << " " << OperationToString.at(op);
+  *next = address + InstructionLength(op);
+  return out.str();
+}
+
+static std::string EscapeJson(const std::string& text){
+  std::string escaped;
+  for(char c : text){
+    if(c == '"' || c == '\\'){
+      escaped += '\\';
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+static b8 WriteDot(const RomAnalysis& analysis, const std::string& path){
+  std::ofstream out(path);
+  if(!out){
+    std::cerr << "Unable to create " << path << std::endl;
+    return false;
+  }
+  out << "digraph \"" << EscapeJson(analysis.name) << "\" {\n";
+  out << "  node [shape=box fontname=\"monospace\"];\n";
+  std::vector<u16> external;
+  for(const BasicBlock& block : analysis.blocks){
+    out << "  \"" << Hex(block.start) << "\" [label=\"";
+    for(u16 address = block.start; address < block.end;){
+      out << Hex(address) << "  " << Disassemble(analysis, address, &address) << "\\l";
+    }
+    out << "\"];\n";
+    for(const Edge& edge : block.edges){
+      out << "  \"" << Hex(block.start) << "\" -> \"" << Hex(edge.target) << "\"";
+      if(edge.kind == EDGE_CALL){
+        out << " [style=dashed]";
+      }
+      else if(edge.kind == EDGE_SKIP){
+        out << " [label=\"skip\"]";
+      }
+      out << ";\n";
+      if(!InRom(analysis, edge.target, 2) || !TestBit(analysis.map.starts, edge.target - ROM_START)){
+        external.push_back(edge.target);
+      }
+    }
+  }
+  for(u16 address : analysis.computedJumps){
+    const BasicBlock& block = *std::find_if(analysis.blocks.begin(), analysis.blocks.end(), [&](const BasicBlock& b){ return address >= b.start && address < b.end; });
+    out << "  \"" << Hex(block.start) << "\" -> \"computed\" [color=red];\n";
+  }
+  if(!analysis.computedJumps.empty()){
+    out << "  \"computed\" [label=\"BNNN target\" shape=diamond color=red];\n";
+  }
+  std::sort(external.begin(), external.end());
+  external.erase(std::unique(external.begin(), external.end()), external.end());
+  for(u16 address : external){
+    out << "  \"" << Hex(address) << "\" [label=\"" << Hex(address) << " (not in ROM code)\" style=dotted];\n";
+  }
+  out << "}\n";
+  return (bool)out;
+}
+
+static b8 WriteJson(const RomAnalysis& analysis, const std::string& path){
+  std::ofstream out(path);
+  if(!out){
+    std::cerr << "Unable to create " << path << std::endl;
+    return false;
+  }
+  out << "{\n";
+  out << "  \"rom\": \"" << EscapeJson(analysis.name) << "\",\n";
+  out << "  \"hash\": \"" << std::hex << std::setw(16) << std::setfill('0') << analysis.map.header.romHash << std::dec << std::setfill(' ') << "\",\n";
+  out << "  \"platform\": \"" << analysis.platform->id << "\",\n";
+  out << "  \"size\": " << analysis.romSize << ",\n";
+  out << "  \"entry\": \"" << Hex(ROM_START) << "\",\n";
+  out << "  \"blocks\": [";
+  for(size_t i = 0; i < analysis.blocks.size(); i++){
+    const BasicBlock& block = analysis.blocks[i];
+    out << (i ? "," : "") << "\n    {\"start\": \"" << Hex(block.start) << "\", \"end\": \"" << Hex(block.end) << "\", \"instructions\": [";
+    for(u16 address = block.start; address < block.end;){
+      const u16 at = address;
+      out << (at != block.start ? ", " : "") << "{\"address\": \"" << Hex(at) << "\", \"text\": \"" << Disassemble(analysis, at, &address) << "\"}";
+    }
+    out << "], \"edges\": [";
+    for(size_t e = 0; e < block.edges.size(); e++){
+      out << (e ? ", " : "") << "{\"target\": \"" << Hex(block.edges[e].target) << "\", \"kind\": \"" << EDGE_NAMES[block.edges[e].kind] << "\"}";
+    }
+    out << "]}";
+  }
+  out << "\n  ],\n";
+  out << "  \"computedJumps\": [";
+  for(size_t i = 0; i < analysis.computedJumps.size(); i++){
+    out << (i ? ", " : "") << "\"" << Hex(analysis.computedJumps[i]) << "\"";
+  }
+  out << "],\n";
+  out << "  \"stores\": [";
+  for(size_t i = 0; i < analysis.stores.size(); i++){
+    const Store& store = analysis.stores[i];
+    out << (i ? "," : "") << "\n    {\"address\": \"" << Hex(store.address) << "\", \"target\": ";
+    if(store.target >= 0){
+      out << "\"" << Hex(store.target) << "\"";
+    }
+    else{
+      out << "null";
+    }
+    out << ", \"length\": " << store.length << ", \"intoCode\": " << (store.intoCode ? "true" : "false") << "}";
+  }
+  out << "\n  ],\n";
+  out << "  \"invalid\": [";
+  for(size_t i = 0; i < analysis.invalid.size(); i++){
+    out << (i ? ", " : "") << "\"" << Hex(analysis.invalid[i]) << "\"";
+  }
+  out << "]\n}\n";
+  return (bool)out;
+}
+
+static b8 IsRomFile(const std::filesystem::path& path){
+  const std::string extension = path.extension().string();
+  return extension == ".ch8" || extension == ".c8" || extension == ".sc8" || extension == ".xo8";
+}
+
+struct RomFile{
+  std::filesystem::path path;
+  std::filesystem::path output;//Where the outputs go under --out, without extension.
+  bool operator<(const RomFile& other) const { return path < other.path; }
+};
+
+int main(int argc, char* argv[]){
+  const PlatformProfile* platform = nullptr;
+  const char* outputDirectory = nullptr;
+  std::vector<RomFile> roms;
+  for(int i = 1; i < argc; i++){
+    if(strcmp(argv[i], "--platform") == 0 && i + 1 < argc){
+      platform = FindPlatform(argv[++i]);
+      if(!platform){
+        std::cerr << "Unknown platform " << argv[i] << std::endl;
+        return 1;
+      }
+    }
+    else if(strcmp(argv[i], "--out") == 0 && i + 1 < argc){
+      outputDirectory = argv[++i];
+    }
+    else if(std::filesystem::is_directory(argv[i])){
+      for(const auto& entry : std::filesystem::recursive_directory_iterator(argv[i])){
+        if(entry.is_regular_file() && IsRomFile(entry.path())){
+          //Mirror the layout under the directory, ROMs with the same name in different folders get their own outputs.
+          roms.push_back({entry.path(), entry.path().lexically_relative(argv[i]).replace_extension()});
+        }
+      }
+    }
+    else{
+      roms.push_back({argv[i], std::filesystem::path(argv[i]).stem()});
+    }
+  }
+  if(roms.empty()){
+    std::cerr << "Usage: chip8analyze [--platform <id>] [--out <directory>] <rom or directory>..." << std::endl;
+    std::cerr << "Writes <rom>.dot, <rom>.json and <rom>.c8map to the output directory for every ROM." << std::endl;
+    std::cerr << "ROMs found in a directory keep their path relative to it, a name used twice gets the ROM hash appended." << std::endl;
+    return 1;
+  }
+  std::sort(roms.begin(), roms.end());
+  if(outputDirectory){
+    std::error_code error;
+    std::filesystem::create_directories(outputDirectory, error);
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::filesystem::path> outputs;
+  for(const RomFile& romFile : roms){
+    const std::filesystem::path& path = romFile.path;
+    std::ifstream inputFile(path, std::ios::binary);
+    if(!inputFile){
+      std::cerr << "Unable to open file " << path.string() << std::endl;
+      return 1;
+    }
+    const std::vector<u8> rom((std::istreambuf_iterator<char>(inputFile)), std::istreambuf_iterator<char>());
+    RomAnalysis analysis = {};
+    analysis.name = path.filename().string();
+    analysis.platform = platform ? platform : DefaultPlatformFor(rom.size());
+    analysis.rom = rom.data();
+    analysis.romSize = (u32)std::min<size_t>(rom.size(), RAM_SIZE - ROM_START);
+    InitCodeMap(&analysis.map, HashRom(rom.data(), rom.size()), analysis.romSize);
+    analysis.leaders.assign(analysis.map.starts.size(), 0);
+    FindCode(analysis);
+    BuildBlocks(analysis);
+
+    u32 codeBytes = 0;
+    for(u32 i = 0; i < analysis.romSize; i++){
+      codeBytes += TestBit(analysis.map.code, i) ? 1 : 0;
+    }
+    const size_t storesIntoCode = std::count_if(analysis.stores.begin(), analysis.stores.end(), [](const Store& s){ return s.intoCode; });
+    const size_t unknownStores = std::count_if(analysis.stores.begin(), analysis.stores.end(), [](const Store& s){ return s.target < 0; });
+    std::cout << analysis.name << ": " << analysis.romSize << " bytes, " << codeBytes << " code, "
+      << analysis.blocks.size() << " blocks, " << analysis.computedJumps.size() << " computed jumps, "
+      << storesIntoCode << " stores into code, " << unknownStores << " stores to unknown addresses" << std::endl;
+
+    if(outputDirectory){
+      std::filesystem::path output = std::filesystem::path(outputDirectory) / romFile.output;
+      if(std::find(outputs.begin(), outputs.end(), output) != outputs.end()){
+        std::ostringstream hash;
+        hash << std::hex << std::setw(16) << std::setfill('0') << analysis.map.header.romHash;
+        output += "-" + hash.str();
+      }
+      outputs.push_back(output);
+      std::error_code error;
+      std::filesystem::create_directories(output.parent_path(), error);
+      const std::string base = output.string();
+      if(!WriteDot(analysis, base + ".dot") || !WriteJson(analysis, base + ".json") || !WriteCodeMap(analysis.map, (base + ".c8map").c_str())){
+        return 1;
+      }
+    }
+  }
+  const f64 ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::cout << roms.size() << " ROM(s) in " << std::fixed << std::setprecision(2) << ms << " ms" << std::endl;
+  return 0;
+}
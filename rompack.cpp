@@ -0,0 +1,221 @@
+#include "rompack.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+
+#if defined(_WIN32)
+  #define WIN32_LEAN_AND_MEAN
+  #define NOMINMAX
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+u64 HashRom(const u8* data, u64 size){
+  u64 hash = 0xcbf29ce484222325ull;
+  for(u64 i = 0; i < size; i++){
+    hash ^= data[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static b8 ValidateRomPack(RomPack* pack, const char* path){
+  if(pack->size < sizeof(RomPackHeader)){
+    std::cerr << "ROM pack " << path << " is too small" << std::endl;
+    return false;
+  }
+  pack->header = (const RomPackHeader*)pack->base;
+  if(memcmp(pack->header->magic, ROM_PACK_MAGIC, sizeof(ROM_PACK_MAGIC)) != 0 || pack->header->version != ROM_PACK_VERSION){
+    std::cerr << "File " << path << " is not a version " << ROM_PACK_VERSION << " ROM pack" << std::endl;
+    return false;
+  }
+  //Offsets come from the file, compare against what's left of it so a crafted value can't wrap around.
+  const u64 entriesOffset = pack->header->entriesOffset;
+  if(entriesOffset % alignof(RomPackEntry) != 0 || entriesOffset > pack->size
+      || pack->header->entryCount > (pack->size - entriesOffset) / sizeof(RomPackEntry)){
+    std::cerr << "ROM pack " << path << " has a corrupt index" << std::endl;
+    return false;
+  }
+  pack->entries = (const RomPackEntry*)(pack->base + pack->header->entriesOffset);
+  for(u32 i = 0; i < pack->header->entryCount; i++){
+    const RomPackEntry& entry = pack->entries[i];
+    if(entry.dataOffset > pack->size || entry.size > pack->size - entry.dataOffset
+        || entry.nameOffset > pack->size || entry.nameLength > pack->size - entry.nameOffset){
+      std::cerr << "ROM pack " << path << " entry " << i << " points outside of the file" << std::endl;
+      return false;
+    }
+    //FindRom binary searches the index.
+    if(i > 0 && pack->entries[i - 1].hash >= entry.hash){
+      std::cerr << "ROM pack " << path << " index is not sorted" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+b8 OpenRomPack(RomPack* pack, const char* path){
+#if defined(_WIN32)
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if(file == INVALID_HANDLE_VALUE){
+    std::cerr << "Unable to open ROM pack " << path << std::endl;
+    return false;
+  }
+  LARGE_INTEGER size;
+  GetFileSizeEx(file, &size);
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  const void* base = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+  if(!base){
+    std::cerr << "Unable to map ROM pack " << path << std::endl;
+    if(mapping){
+      CloseHandle(mapping);
+    }
+    CloseHandle(file);
+    return false;
+  }
+  pack->file = file;
+  pack->mapping = mapping;
+  pack->size = (u64)size.QuadPart;
+#else
+  int fd = open(path, O_RDONLY);
+  if(fd < 0){
+    std::cerr << "Unable to open ROM pack " << path << std::endl;
+    return false;
+  }
+  struct stat info;
+  void* base = fstat(fd, &info) == 0 && info.st_size > 0 ? mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  if(base == MAP_FAILED){
+    std::cerr << "Unable to map ROM pack " << path << std::endl;
+    close(fd);
+    return false;
+  }
+  pack->fd = fd;
+  pack->size = (u64)info.st_size;
+#endif
+  pack->base = (const u8*)base;
+  if(!ValidateRomPack(pack, path)){
+    CloseRomPack(pack);
+    return false;
+  }
+  return true;
+}
+
+void CloseRomPack(RomPack* pack){
+  if(!pack->base){
+    return;
+  }
+#if defined(_WIN32)
+  UnmapViewOfFile(pack->base);
+  CloseHandle(pack->mapping);
+  CloseHandle(pack->file);
+#else
+  munmap((void*)pack->base, pack->size);
+  close(pack->fd);
+#endif
+  *pack = RomPack{};
+}
+
+const RomPackEntry* FindRom(const RomPack& pack, u64 hash){
+  const RomPackEntry* begin = pack.entries;
+  const RomPackEntry* end = pack.entries + pack.header->entryCount;
+  const RomPackEntry* it = std::lower_bound(begin, end, hash, [](const RomPackEntry& entry, u64 h){ return entry.hash < h; });
+  if(it != end && it->hash == hash){
+    return it;
+  }
+  return nullptr;
+}
+
+b8 BuildRomPack(const char* path, const std::vector<RomPackInput>& roms){
+  struct PendingRom{
+    RomPackEntry entry;
+    std::vector<u8> data;
+    std::string name;
+    const std::string* path;
+  };
+  std::vector<PendingRom> pending;
+  pending.reserve(roms.size());
+  for(const RomPackInput& rom : roms){
+    std::ifstream inputFile(rom.path, std::ios::binary);
+    if(!inputFile){
+      std::cerr << "Unable to open file " << rom.path << std::endl;
+      return false;
+    }
+    PendingRom p = {};
+    p.data.assign(std::istreambuf_iterator<char>(inputFile), std::istreambuf_iterator<char>());
+    p.entry.hash = HashRom(p.data.data(), p.data.size());
+    p.entry.size = (u32)p.data.size();
+    p.entry.platform = rom.platform;
+    p.entry.tickrate = rom.tickrate;
+    p.name = rom.path.substr(rom.path.find_last_of("/\\") + 1).substr(0, 255);
+    p.entry.nameLength = (u8)p.name.size();
+    p.path = &rom.path;
+    pending.push_back(std::move(p));
+  }
+  std::stable_sort(pending.begin(), pending.end(), [](const PendingRom& a, const PendingRom& b){ return a.entry.hash < b.entry.hash; });
+  //A duplicate is only dropped when it asks for the same settings as the copy that's kept, one entry per hash can't hold both.
+  size_t kept = 0;
+  b8 conflict = false;
+  for(size_t i = 0; i < pending.size(); i++){
+    if(kept && pending[kept - 1].entry.hash == pending[i].entry.hash){
+      const PendingRom& first = pending[kept - 1];
+      if(first.entry.platform != pending[i].entry.platform || first.entry.tickrate != pending[i].entry.tickrate){
+        std::cerr << "ROM " << *pending[i].path << " is the same as " << *first.path << " but with a different platform or tickrate" << std::endl;
+        conflict = true;
+      }
+      continue;
+    }
+    if(kept != i){
+      pending[kept] = std::move(pending[i]);
+    }
+    kept++;
+  }
+  if(conflict){
+    return false;
+  }
+  if(kept != pending.size()){
+    std::cout << "Skipping " << (pending.size() - kept) << " duplicate ROM(s)" << std::endl;
+    pending.resize(kept);
+  }
+
+  RomPackHeader header = {};
+  memcpy(header.magic, ROM_PACK_MAGIC, sizeof(ROM_PACK_MAGIC));
+  header.version = ROM_PACK_VERSION;
+  header.entryCount = (u32)pending.size();
+  header.entriesOffset = sizeof(RomPackHeader);
+  u64 offset = header.entriesOffset + pending.size() * sizeof(RomPackEntry);
+  for(PendingRom& p : pending){
+    p.entry.dataOffset = offset;
+    offset += p.entry.size;
+    if(offset > UINT32_MAX){
+      std::cerr << "ROM pack " << path << " would be bigger than 4GB" << std::endl;
+      return false;
+    }
+    p.entry.nameOffset = (u32)offset;
+    offset += p.entry.nameLength;
+  }
+
+  std::ofstream outputFile(path, std::ios::binary);
+  if(!outputFile){
+    std::cerr << "Unable to create ROM pack " << path << std::endl;
+    return false;
+  }
+  outputFile.write((const char*)&header, sizeof(header));
+  for(const PendingRom& p : pending){
+    outputFile.write((const char*)&p.entry, sizeof(p.entry));
+  }
+  for(const PendingRom& p : pending){
+    outputFile.write((const char*)p.data.data(), p.data.size());
+    outputFile.write(p.name.data(), p.name.size());
+  }
+  if(!outputFile){
+    std::cerr << "Error writing ROM pack " << path << std::endl;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+//ROM corpus pack: every ROM of a corpus in a single file that gets memory-mapped, so batch jobs
+//don't pay for opening and reading thousands of small files.
+//
+//Layout:
+//  RomPackHeader
+//  RomPackEntry[entryCount], sorted by hash so lookups are a binary search
+//  ROM data and names, referenced by offset from the start of the file
+//
+//Everything is little-endian and naturally aligned, entries are used in place from the mapping.
+
+constexpr char ROM_PACK_MAGIC[8] = {'C', '8', 'P', 'A', 'C', 'K', '\0', '\0'};
+constexpr u32 ROM_PACK_VERSION = 1;
+
+struct RomPackHeader{
+  char magic[8];
+  u32 version;
+  u32 entryCount;
+  u64 entriesOffset;
+};
+static_assert(sizeof(RomPackHeader) == 24);
+
+struct RomPackEntry{
+  u64 hash;//HashRom() of the ROM contents
+  u64 dataOffset;
+  u32 size;
+  u32 nameOffset;//File name of the ROM when the pack was built, not null terminated.
+  u16 tickrate;//Instructions per 60Hz frame, given per ROM when the pack is built or the platform's defaultTickrate.
+  u8 platform;//Index into PLATFORMS, the table order is part of the file format.
+  u8 nameLength;
+  u32 reserved;
+};
+static_assert(sizeof(RomPackEntry) == 32);
+
+struct RomPack{
+  const u8* base = nullptr;
+  u64 size = 0;
+  const RomPackHeader* header = nullptr;
+  const RomPackEntry* entries = nullptr;
+#if defined(_WIN32)
+  void* file = nullptr;
+  void* mapping = nullptr;
+#else
+  int fd = -1;
+#endif
+};
+
+//Input for BuildRomPack, the platform and tickrate are resolved by the caller.
+struct RomPackInput{
+  std::string path;
+  u8 platform;
+  u16 tickrate;
+};
+
+//FNV-1a, ROMs are small and this only needs to tell them apart.
+u64 HashRom(const u8* data, u64 size);
+//Returns false and prints the reason if the file can't be mapped or isn't a valid pack.
+b8 OpenRomPack(RomPack* pack, const char* path);
+void CloseRomPack(RomPack* pack);
+const RomPackEntry* FindRom(const RomPack& pack, u64 hash);
+//Identical ROMs are only stored once, the first path wins.
+b8 BuildRomPack(const char* path, const std::vector<RomPackInput>& roms);
+
+inline const u8* RomData(const RomPack& pack, const RomPackEntry& entry){
+  return pack.base + entry.dataOffset;
+}
+inline std::string RomName(const RomPack& pack, const RomPackEntry& entry){
+  return std::string((const char*)pack.base + entry.nameOffset, entry.nameLength);
+}
@@ -0,0 +1,205 @@
+#include "scaler.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define SCALER_SSE2
+  #include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  #define SCALER_NEON
+  #include <arm_neon.h>
+#endif
+
+constexpr u32 ROW_PIXELS = CHIP8_HIRES_DISPLAY_WIDTH;
+
+void InitScaler(Scaler* scaler, u32 scale, u32 persistencePercent){
+  scaler->scale = std::clamp(scale, 1u, MAX_SCALE);
+  scaler->width = CHIP8_HIRES_DISPLAY_WIDTH * scaler->scale;
+  scaler->height = CHIP8_HIRES_DISPLAY_HEIGHT * scaler->scale;
+  scaler->persistence = (u8)(std::min(persistencePercent, 99u) * 256 / 100);
+  scaler->fading = false;
+  std::fill_n(&scaler->glow[0][0], CHIP8_HIRES_DISPLAY_WIDTH * CHIP8_HIRES_DISPLAY_HEIGHT, PALETTE[0]);
+  scaler->pixels.assign((size_t)scaler->width * scaler->height, PALETTE[0]);
+}
+
+//Turns one row of the packed planes into palette colors at hi-res width, lo-res pixels are doubled.
+//Four pixels at a time: their bits are broadcast to every lane, each lane tests its own bit, and the
+//two plane masks pick between the four palette entries.
+static void ExpandRow(const DisplayPlanes& display, b8 hires, u32 row, u32* out){
+  const u32 sourceRow = hires ? row : row / 2;
+  const u64* plane1 = display[0][sourceRow];
+  const u64* plane2 = display[1][sourceRow];
+#if defined(SCALER_SSE2) || defined(SCALER_NEON)
+  const u32 pixelsPerGroup = hires ? 4 : 2;//Source pixels behind four output pixels.
+  const u32 groupMask = (1u << pixelsPerGroup) - 1;
+#endif
+#if defined(SCALER_SSE2)
+  const __m128i bits = hires ? _mm_set_epi32(1, 2, 4, 8) : _mm_set_epi32(1, 1, 2, 2);
+  const __m128i color0 = _mm_set1_epi32((int)PALETTE[0]);
+  const __m128i color2 = _mm_set1_epi32((int)PALETTE[2]);
+  const __m128i flip01 = _mm_set1_epi32((int)(PALETTE[0] ^ PALETTE[1]));
+  const __m128i flip23 = _mm_set1_epi32((int)(PALETTE[2] ^ PALETTE[3]));
+  for(u32 x = 0; x < ROW_PIXELS; x += 4){
+    const u32 column = x / 4 * pixelsPerGroup;
+    const u32 shift = 64 - pixelsPerGroup - column % 64;
+    const __m128i group1 = _mm_set1_epi32((int)((plane1[column / 64] >> shift) & groupMask));
+    const __m128i group2 = _mm_set1_epi32((int)((plane2[column / 64] >> shift) & groupMask));
+    const __m128i mask1 = _mm_cmpeq_epi32(_mm_and_si128(group1, bits), bits);
+    const __m128i mask2 = _mm_cmpeq_epi32(_mm_and_si128(group2, bits), bits);
+    const __m128i low = _mm_xor_si128(color0, _mm_and_si128(flip01, mask1));//PALETTE[0] or [1]
+    const __m128i high = _mm_xor_si128(color2, _mm_and_si128(flip23, mask1));//PALETTE[2] or [3]
+    _mm_store_si128((__m128i*)(out + x), _mm_xor_si128(low, _mm_and_si128(_mm_xor_si128(low, high), mask2)));
+  }
+#elif defined(SCALER_NEON)
+  const u32 laneBits[2][4] = {{2, 2, 1, 1}, {8, 4, 2, 1}};
+  const uint32x4_t bits = vld1q_u32(laneBits[hires ? 1 : 0]);
+  const uint32x4_t color0 = vdupq_n_u32(PALETTE[0]);
+  const uint32x4_t color1 = vdupq_n_u32(PALETTE[1]);
+  const uint32x4_t color2 = vdupq_n_u32(PALETTE[2]);
+  const uint32x4_t color3 = vdupq_n_u32(PALETTE[3]);
+  for(u32 x = 0; x < ROW_PIXELS; x += 4){
+    const u32 column = x / 4 * pixelsPerGroup;
+    const u32 shift = 64 - pixelsPerGroup - column % 64;
+    const uint32x4_t mask1 = vtstq_u32(vdupq_n_u32((u32)(plane1[column / 64] >> shift) & groupMask), bits);
+    const uint32x4_t mask2 = vtstq_u32(vdupq_n_u32((u32)(plane2[column / 64] >> shift) & groupMask), bits);
+    const uint32x4_t low = vbslq_u32(mask1, color1, color0);
+    const uint32x4_t high = vbslq_u32(mask1, color3, color2);
+    vst1q_u32(out + x, vbslq_u32(mask2, high, low));
+  }
+#else
+  for(u32 x = 0; x < ROW_PIXELS; x++){
+    const u32 column = hires ? x : x / 2;
+    const u32 bit = 63 - column % 64;
+    out[x] = PALETTE[((plane1[column / 64] >> bit) & 1) | (((plane2[column / 64] >> bit) & 1) << 1)];
+  }
+#endif
+}
+
+//glow = max(current, glow * persistence / 256) on every channel.
+static void BlendRow(u32* glow, const u32* current, u8 persistence){
+#if defined(SCALER_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i keep = _mm_set1_epi16(persistence);
+  for(u32 i = 0; i < ROW_PIXELS; i += 4){
+    const __m128i previous = _mm_load_si128((const __m128i*)(glow + i));
+    const __m128i low = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(previous, zero), keep), 8);
+    const __m128i high = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(previous, zero), keep), 8);
+    const __m128i faded = _mm_packus_epi16(low, high);
+    _mm_store_si128((__m128i*)(glow + i), _mm_max_epu8(faded, _mm_load_si128((const __m128i*)(current + i))));
+  }
+#elif defined(SCALER_NEON)
+  const uint8x8_t keep = vdup_n_u8(persistence);
+  for(u32 i = 0; i < ROW_PIXELS; i += 4){
+    const uint8x16_t previous = vld1q_u8((const u8*)(glow + i));
+    const uint8x8_t low = vshrn_n_u16(vmull_u8(vget_low_u8(previous), keep), 8);
+    const uint8x8_t high = vshrn_n_u16(vmull_u8(vget_high_u8(previous), keep), 8);
+    vst1q_u8((u8*)(glow + i), vmaxq_u8(vcombine_u8(low, high), vld1q_u8((const u8*)(current + i))));
+  }
+#else
+  u8* out = (u8*)glow;
+  const u8* in = (const u8*)current;
+  for(u32 i = 0; i < ROW_PIXELS * 4; i++){
+    out[i] = std::max<u8>(in[i], (u8)((out[i] * persistence) >> 8));
+  }
+#endif
+}
+
+//Repeats every pixel scale times horizontally.
+static void ScaleRow(const u32* source, u32 scale, u32* out){
+  if(scale == 1){
+    memcpy(out, source, ROW_PIXELS * sizeof(u32));
+    return;
+  }
+#if defined(SCALER_SSE2)
+  if(scale == 2){
+    for(u32 x = 0; x < ROW_PIXELS; x += 4){
+      const __m128i pixels = _mm_load_si128((const __m128i*)(source + x));
+      _mm_storeu_si128((__m128i*)(out + x*2), _mm_unpacklo_epi32(pixels, pixels));
+      _mm_storeu_si128((__m128i*)(out + x*2 + 4), _mm_unpackhi_epi32(pixels, pixels));
+    }
+    return;
+  }
+  if(scale % 4 == 0){
+    for(u32 x = 0; x < ROW_PIXELS; x++, out += scale){
+      const __m128i pixel = _mm_set1_epi32((int)source[x]);
+      for(u32 i = 0; i < scale; i += 4){
+        _mm_storeu_si128((__m128i*)(out + i), pixel);
+      }
+    }
+    return;
+  }
+#elif defined(SCALER_NEON)
+  if(scale == 2){
+    for(u32 x = 0; x < ROW_PIXELS; x += 4){
+      uint32x4x2_t pairs;
+      pairs.val[0] = vld1q_u32(source + x);
+      pairs.val[1] = pairs.val[0];
+      vst2q_u32(out + x*2, pairs);
+    }
+    return;
+  }
+  if(scale % 4 == 0){
+    for(u32 x = 0; x < ROW_PIXELS; x++, out += scale){
+      const uint32x4_t pixel = vdupq_n_u32(source[x]);
+      for(u32 i = 0; i < scale; i += 4){
+        vst1q_u32(out + i, pixel);
+      }
+    }
+    return;
+  }
+#endif
+  for(u32 x = 0; x < ROW_PIXELS; x++){
+    std::fill_n(out, scale, source[x]);
+    out += scale;
+  }
+}
+
+//Writes one scaled row to the image. The image is much bigger than the cache when a lot of emulators run at once,
+//non-temporal stores keep it from evicting everything else and skip reading the destination in first.
+static void StoreRow(u32* out, const u32* row, u32 width){
+#if defined(SCALER_SSE2)
+  if(((uintptr_t)out & 15) == 0){
+    for(u32 i = 0; i < width; i += 4){
+      _mm_stream_si128((__m128i*)(out + i), _mm_load_si128((const __m128i*)(row + i)));
+    }
+    return;
+  }
+#endif
+  memcpy(out, row, width * sizeof(u32));
+}
+
+b8 UpdateScaler(Scaler* scaler, const DisplayPlanes& display, b8 hires){
+  alignas(16) u32 current[ROW_PIXELS];
+  alignas(16) u32 blended[ROW_PIXELS];
+  alignas(16) u32 scaled[ROW_PIXELS * MAX_SCALE];
+  b8 changed = false;
+  b8 fading = false;
+  for(u32 row = 0; row < CHIP8_HIRES_DISPLAY_HEIGHT; row++){
+    ExpandRow(display, hires, row, current);
+    u32* glow = scaler->glow[row];
+    if(scaler->persistence){
+      memcpy(blended, glow, sizeof(blended));
+      BlendRow(blended, current, scaler->persistence);
+      fading |= memcmp(blended, current, sizeof(current)) != 0;
+    }
+    else{
+      memcpy(blended, current, sizeof(blended));
+    }
+    if(memcmp(blended, glow, sizeof(blended)) == 0){
+      continue;
+    }
+    memcpy(glow, blended, sizeof(blended));
+    changed = true;
+    ScaleRow(glow, scaler->scale, scaled);
+    u32* out = scaler->pixels.data() + (size_t)row * scaler->scale * scaler->width;
+    for(u32 copy = 0; copy < scaler->scale; copy++){
+      StoreRow(out + (size_t)copy * scaler->width, scaled, scaler->width);
+    }
+  }
+#if defined(SCALER_SSE2)
+  _mm_sfence();
+#endif
+  scaler->fading = fading;
+  return changed;
+}
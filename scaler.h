@@ -0,0 +1,26 @@
+#pragma once
+#include <vector>
+
+#include "types.h"
+#include "display.h"
+
+//CPU side display pipeline, no GPU needed: packed planes -> ARGB8888 at any integer scale, SIMD where available.
+//Phosphor persistence: a pixel that turns off fades out over the next frames instead of going dark at once,
+//which hides the flicker of games that erase and redraw their sprites every frame.
+//Only rows that changed get rescaled, an idle display costs one blend at native resolution per frame.
+
+constexpr u32 MAX_SCALE = 32;
+struct Scaler{
+  u32 scale = 1;
+  u32 width = 0;//Size of pixels, the hi-res display times scale.
+  u32 height = 0;
+  u8 persistence = 0;//Brightness kept from the previous frame, out of 256. 0 turns blending off.
+  b8 fading = false;//Pixels are still fading out, the image keeps changing while the display doesn't.
+  alignas(16) u32 glow[CHIP8_HIRES_DISPLAY_HEIGHT][CHIP8_HIRES_DISPLAY_WIDTH];//Blended image at native resolution.
+  std::vector<u32> pixels;//Scaled image, width * height.
+};
+
+//persistencePercent is how much of a pixel's brightness survives each frame, 0 to 99.
+void InitScaler(Scaler* scaler, u32 scale, u32 persistencePercent);
+//Blends the display into the image and rescales the rows that changed. Returns false if the image is unchanged.
+b8 UpdateScaler(Scaler* scaler, const DisplayPlanes& display, b8 hires);